@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <green/utils/mpi_utils.h>
+#include <green/utils/timing.h>
+
+#include <string>
+
+/**
+ * Startup cost of the MPI context: eager communicator splits versus topology discovery with lazily created
+ * communicators.
+ *
+ * Usage: mpirun -np N context_startup_bench [repetitions]
+ */
+int main(int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  {
+    int                  repetitions = argc > 1 ? std::stoi(argv[1]) : 10;
+    green::utils::timing statistic("context startup");
+    for (int i = 0; i < repetitions; ++i) {
+      int      rank, node_rank, node_size, internode_rank, internode_size;
+      MPI_Comm node_comm, internode_comm;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      MPI_Barrier(MPI_COMM_WORLD);
+      statistic.start("EAGER SPLITS");
+      green::utils::setup_communicators(MPI_COMM_WORLD, rank, node_comm, node_rank, node_size, internode_comm,
+                                        internode_rank, internode_size);
+      statistic.end();
+      MPI_Comm_free(&node_comm);
+      if (internode_comm != MPI_COMM_NULL) MPI_Comm_free(&internode_comm);
+
+      MPI_Barrier(MPI_COMM_WORLD);
+      statistic.start("LAZY CONTEXT");
+      green::utils::mpi_context ctx(MPI_COMM_WORLD);
+      statistic.end();
+      statistic.start("FIRST NODE COMM USE");
+      MPI_Barrier(ctx.node_comm);
+      statistic.end();
+      statistic.start("FIRST INTERNODE COMM USE");
+      if (ctx.internode_comm != MPI_COMM_NULL) MPI_Barrier(ctx.internode_comm);
+      statistic.end();
+    }
+    statistic.print(green::utils::mpi_context::context());
+  }
+  MPI_Finalize();
+  return 0;
+}
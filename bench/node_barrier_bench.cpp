@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <green/utils/mpi_utils.h>
+#include <green/utils/timing.h>
+
+#include <string>
+
+/**
+ * Compare node-level MPI_Barrier against shared memory barrier.
+ *
+ * Usage: mpirun -np N node_barrier_bench [iterations] [spin count]
+ *
+ * Negative or omitted spin count selects the default wait policy of the barrier.
+ */
+int main(int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  {
+    int   iterations = argc > 1 ? std::stoi(argv[1]) : 10000;
+    int   spin_count = argc > 2 ? std::stoi(argv[2]) : -1;
+    auto& ctx        = green::utils::mpi_context::context();
+    green::utils::timing       statistic("node barrier");
+    green::utils::node_barrier barrier(ctx.node_comm, spin_count);
+    barrier.wait();
+    MPI_Barrier(ctx.node_comm);
+
+    statistic.start("MPI_Barrier");
+    for (int i = 0; i < iterations; ++i) MPI_Barrier(ctx.node_comm);
+    statistic.end();
+
+    statistic.start("node_barrier");
+    for (int i = 0; i < iterations; ++i) barrier.wait();
+    statistic.end();
+
+    if (!ctx.global_rank)
+      std::cout << iterations << " iterations on " << ctx.node_size << " ranks per node, spin count " << barrier.spin_count()
+                << std::endl;
+    statistic.print(ctx.global);
+  }
+  MPI_Finalize();
+  return 0;
+}
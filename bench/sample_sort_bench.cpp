@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <green/utils/mpi_sort.h>
+#include <green/utils/timing.h>
+
+#include <random>
+#include <string>
+
+struct record {
+  unsigned long key;
+  double        payload;
+};
+
+/**
+ * Distributed sample sort of random (key, payload) records.
+ *
+ * Usage: mpirun -np N sample_sort_bench [records per rank] [threads per rank]
+ */
+int main(int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  {
+    size_t count   = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    int    threads = argc > 2 ? std::stoi(argv[2]) : 1;
+    auto&  ctx     = green::utils::mpi_context::context();
+    green::utils::timing statistic("sample sort");
+    std::mt19937_64      gen(ctx.global_rank);
+    std::vector<record>  data(count);
+    for (auto& r : data) r = record{gen(), double(ctx.global_rank)};
+    MPI_Barrier(ctx.global);
+    statistic.start("sample_sort");
+    green::utils::sample_sort(data, ctx.global, [](const record& a, const record& b) { return a.key < b.key; }, threads);
+    statistic.end();
+    size_t min = data.size(), max = data.size();
+    MPI_Allreduce(MPI_IN_PLACE, &min, 1, MPI_UNSIGNED_LONG, MPI_MIN, ctx.global);
+    MPI_Allreduce(MPI_IN_PLACE, &max, 1, MPI_UNSIGNED_LONG, MPI_MAX, ctx.global);
+    if (!ctx.global_rank) {
+      std::cout << count << " records per rank on " << ctx.global_size << " ranks, records per rank after sort: min " << min
+                << ", max " << max << std::endl;
+    }
+    statistic.print(ctx.global);
+  }
+  MPI_Finalize();
+  return 0;
+}
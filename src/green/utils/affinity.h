@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef GREEN_UTILS_AFFINITY_H
+#define GREEN_UTILS_AFFINITY_H
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace green::utils {
+
+  /**
+   * @param tid - thread id, 0 for the calling thread
+   * @return cores the thread is allowed to run on, in increasing order
+   */
+  inline std::vector<int> get_affinity(pid_t tid = 0) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    std::vector<int> cpus;
+    if (sched_getaffinity(tid, sizeof(mask), &mask) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &mask)) cpus.push_back(cpu);
+    return cpus;
+  }
+
+  /**
+   * Restrict thread to the given cores.
+   *
+   * @param cpus - allowed cores
+   * @param tid - thread id, 0 for the calling thread
+   * @return true on success
+   */
+  inline bool set_affinity(const std::vector<int>& cpus, pid_t tid = 0) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus)
+      if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &mask);
+    return !cpus.empty() && sched_setaffinity(tid, sizeof(mask), &mask) == 0;
+  }
+
+  /**
+   * Format list of cores in the sysfs notation, e.g. "0-3,8".
+   */
+  inline std::string cpu_list(const std::vector<int>& cpus) {
+    std::string result;
+    for (size_t i = 0; i < cpus.size();) {
+      size_t j = i;
+      while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+      if (!result.empty()) result += ',';
+      result += std::to_string(cpus[i]);
+      if (j > i) result += '-' + std::to_string(cpus[j]);
+      i = j + 1;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Binding of the threads created by green-utils.
+   *
+   * Long-living helper threads (checkpoint worker, watchdog) register themselves while they run, so that re-pinning of
+   * the process moves them together with the calling thread. Short-living worker threads inherit the binding of the
+   * thread that creates them and, once the process has been bound, pin themselves to one core of the process set each.
+   */
+  class thread_binding {
+  public:
+    static thread_binding& get_instance() {
+      static thread_binding instance;
+      return instance;
+    }
+
+    /**
+     * Register the calling thread so that its affinity follows the binding of the process.
+     */
+    void add_current() {
+      std::lock_guard lock(_mutex);
+      pid_t           tid = syscall(SYS_gettid);
+      _threads.push_back(tid);
+      if (!_cpus.empty()) set_affinity(_cpus, tid);
+    }
+
+    void remove_current() {
+      std::lock_guard lock(_mutex);
+      pid_t           tid = syscall(SYS_gettid);
+      _threads.erase(std::remove(_threads.begin(), _threads.end(), tid), _threads.end());
+    }
+
+    /**
+     * Bind the calling thread and all registered threads to the given cores.
+     *
+     * @param cpus - cores of the process
+     * @return true if the calling thread has been bound
+     */
+    bool bind(const std::vector<int>& cpus) {
+      std::lock_guard lock(_mutex);
+      if (!set_affinity(cpus)) return false;
+      _cpus = cpus;
+      for (pid_t tid : _threads) set_affinity(_cpus, tid);
+      return true;
+    }
+
+    /**
+     * Forget the binding of the process and move the calling thread and all registered threads to the given cores.
+     *
+     * @param cpus - cores to restore, e.g. the mask saved before binding
+     */
+    void unbind(const std::vector<int>& cpus) {
+      std::lock_guard lock(_mutex);
+      _cpus.clear();
+      set_affinity(cpus);
+      for (pid_t tid : _threads) set_affinity(cpus, tid);
+    }
+
+    /**
+     * Pin the calling worker thread to one core of the process set, no-op unless the process has been bound.
+     *
+     * @param index - index of the worker thread
+     */
+    void pin_worker(int index) {
+      std::lock_guard lock(_mutex);
+      if (!_cpus.empty()) set_affinity({_cpus[index % _cpus.size()]});
+    }
+
+    /**
+     * @return cores of the process, empty if the process has not been bound
+     */
+    std::vector<int> cpus() {
+      std::lock_guard lock(_mutex);
+      return _cpus;
+    }
+
+  private:
+    std::mutex         _mutex;
+    std::vector<pid_t> _threads;
+    std::vector<int>   _cpus;
+  };
+
+  /**
+   * @brief Registers the calling thread in `thread_binding` for the lifetime of the object.
+   */
+  class bound_thread {
+  public:
+    bound_thread() { thread_binding::get_instance().add_current(); }
+    ~bound_thread() { thread_binding::get_instance().remove_current(); }
+
+    bound_thread(const bound_thread&)            = delete;
+    bound_thread& operator=(const bound_thread&) = delete;
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_AFFINITY_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_BUFFER_POOL_H
+#define GREEN_UTILS_BUFFER_POOL_H
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "timing.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Thread-safe pool of temporary communication buffers.
+   *
+   * Buffers are rounded up to power-of-two size classes (at least one page) and released buffers are kept for reuse, so
+   * repeated calls of communication helpers do not pay for page faults and first touch of fresh memory. Total size of
+   * cached buffers is bounded by `max_cached`, buffers that do not fit are returned to the system. Buffers are aligned to
+   * `alignment` bytes; with huge pages enabled, buffers of at least 2 MiB are mapped with transparent huge pages.
+   */
+  class buffer_pool {
+  public:
+    struct stats_t {
+      size_t hits   = 0;
+      size_t misses = 0;
+      size_t cached = 0;
+      size_t in_use = 0;
+      size_t peak   = 0;
+    };
+
+    static constexpr size_t min_class_size = size_t(1) << 12;
+    static constexpr size_t huge_page_size = size_t(1) << 21;
+
+    /**
+     * Global buffer pool used by green-utils communication helpers
+     */
+    static buffer_pool& get_instance() {
+      static buffer_pool instance;
+      return instance;
+    }
+
+    /**
+     * @param max_cached - maximal total size of cached buffers in bytes
+     * @param alignment - buffer alignment in bytes, power of two not larger than the page size
+     * @param huge_pages - back large buffers with transparent huge pages
+     */
+    explicit buffer_pool(size_t max_cached = size_t(1) << 28, size_t alignment = 64, bool huge_pages = false) :
+        _max_cached(max_cached), _alignment(alignment), _huge_pages(huge_pages) {}
+
+    buffer_pool(const buffer_pool&)            = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    ~buffer_pool() { shrink(0); }
+
+    /**
+     * Get buffer of at least `bytes` bytes.
+     */
+    void* allocate(size_t bytes) {
+      size_t cls = size_class(bytes);
+      {
+        std::lock_guard lock(_mutex);
+        auto&           free = free_list(cls);
+        if (!free.empty()) {
+          void* ptr = free.back();
+          free.pop_back();
+          _stats.cached -= class_bytes(cls);
+          _stats.in_use += class_bytes(cls);
+          ++_stats.hits;
+          return ptr;
+        }
+        ++_stats.misses;
+      }
+      double          start = MPI_Wtime();
+      void*           ptr   = system_allocate(class_bytes(cls));
+      std::lock_guard lock(_mutex);
+      _allocation_time += MPI_Wtime() - start;
+      // buffer is accounted only once it has been obtained, a failed allocation leaves statistics unchanged
+      _stats.in_use += class_bytes(cls);
+      _stats.peak = std::max(_stats.peak, _stats.in_use + _stats.cached);
+      return ptr;
+    }
+
+    /**
+     * @return number of bytes actually taken by a buffer of `bytes` bytes, i.e. the size of its size class
+     */
+    static size_t allocated_bytes(size_t bytes) { return class_bytes(size_class(bytes)); }
+
+    /**
+     * Return buffer obtained with `allocate(bytes)` to the pool.
+     */
+    void release(void* ptr, size_t bytes) {
+      if (!ptr) return;
+      size_t cls = size_class(bytes);
+      {
+        std::lock_guard lock(_mutex);
+        _stats.in_use -= class_bytes(cls);
+        if (_stats.cached + class_bytes(cls) <= _max_cached) {
+          free_list(cls).push_back(ptr);
+          _stats.cached += class_bytes(cls);
+          return;
+        }
+      }
+      system_release(ptr, class_bytes(cls));
+    }
+
+    /**
+     * Return cached buffers to the system until at most `target` bytes stay cached, largest buffers go first.
+     */
+    void shrink(size_t target = 0) {
+      std::lock_guard lock(_mutex);
+      for (size_t cls = _free.size(); cls-- > 0 && _stats.cached > target;) {
+        while (!_free[cls].empty() && _stats.cached > target) {
+          system_release(_free[cls].back(), class_bytes(cls));
+          _free[cls].pop_back();
+          _stats.cached -= class_bytes(cls);
+        }
+      }
+    }
+
+    stats_t stats() const {
+      std::lock_guard lock(_mutex);
+      return _stats;
+    }
+
+    /**
+     * Add pool statistics to the timing object: time spent in fresh allocations as an event, buffer counts and sizes as
+     * counters.
+     */
+    void report(timing& statistic) const {
+      std::lock_guard lock(_mutex);
+      statistic.event("BUFFER POOL ALLOCATE").duration = _allocation_time;
+      statistic.counter("buffer pool hits")            = _stats.hits;
+      statistic.counter("buffer pool misses")          = _stats.misses;
+      statistic.counter("buffer pool cached bytes")    = _stats.cached;
+      statistic.counter("buffer pool peak bytes")      = _stats.peak;
+    }
+
+  private:
+    size_t                          _max_cached;
+    size_t                          _alignment;
+    bool                            _huge_pages;
+    stats_t                         _stats;
+    double                          _allocation_time = 0.0;
+    std::vector<std::vector<void*>> _free;
+    mutable std::mutex              _mutex;
+
+    static size_t size_class(size_t bytes) {
+      size_t cls = 0;
+      while ((min_class_size << cls) < bytes) ++cls;
+      return cls;
+    }
+
+    static size_t       class_bytes(size_t cls) { return min_class_size << cls; }
+
+    std::vector<void*>& free_list(size_t cls) {
+      if (_free.size() <= cls) _free.resize(cls + 1);
+      return _free[cls];
+    }
+
+    bool mapped(size_t bytes) const { return _huge_pages && bytes >= huge_page_size; }
+
+    void* system_allocate(size_t bytes) const {
+      if (mapped(bytes)) {
+        void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+        return ptr;
+      }
+      void* ptr = std::aligned_alloc(_alignment, bytes);
+      if (!ptr) throw std::bad_alloc();
+      return ptr;
+    }
+
+    void system_release(void* ptr, size_t bytes) const {
+      if (mapped(bytes)) {
+        munmap(ptr, bytes);
+      } else {
+        std::free(ptr);
+      }
+    }
+  };
+
+  /**
+   * @brief Buffer of `count` elements of type T borrowed from a buffer pool and returned to it on destruction.
+   *
+   * @tparam T - trivially copyable element type, elements are not initialized
+   */
+  template <typename T>
+  class pooled_buffer {
+    static_assert(std::is_trivially_copyable_v<T>, "Pooled buffers hold trivially copyable elements.");
+
+  public:
+    pooled_buffer() = default;
+    explicit pooled_buffer(size_t count, buffer_pool& pool = buffer_pool::get_instance()) :
+        _pool(&pool), _data(static_cast<T*>(pool.allocate(count * sizeof(T)))), _size(count) {}
+
+    pooled_buffer(const pooled_buffer&)            = delete;
+    pooled_buffer& operator=(const pooled_buffer&) = delete;
+    pooled_buffer(pooled_buffer&& rhs) noexcept : _pool(rhs._pool), _data(rhs._data), _size(rhs._size) {
+      rhs._data = nullptr;
+      rhs._size = 0;
+    }
+    pooled_buffer& operator=(pooled_buffer&& rhs) noexcept {
+      std::swap(_pool, rhs._pool);
+      std::swap(_data, rhs._data);
+      std::swap(_size, rhs._size);
+      return *this;
+    }
+
+    ~pooled_buffer() {
+      if (_data) _pool->release(_data, _size * sizeof(T));
+    }
+
+    T*       data() { return _data; }
+    const T* data() const { return _data; }
+    size_t   size() const { return _size; }
+    T&       operator[](size_t i) { return _data[i]; }
+    const T& operator[](size_t i) const { return _data[i]; }
+
+  private:
+    buffer_pool* _pool = nullptr;
+    T*           _data = nullptr;
+    size_t       _size = 0;
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_BUFFER_POOL_H
@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_CHECKPOINT_H
+#define GREEN_UTILS_CHECKPOINT_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "affinity.h"
+#include "buffer_pool.h"
+#include "mpi_shared.h"
+#include "timing.h"
+
+namespace green::utils {
+
+  /**
+   * Completion handle of an asynchronous checkpoint request.
+   */
+  class checkpoint_handle {
+  public:
+    checkpoint_handle() = default;
+    explicit checkpoint_handle(std::shared_future<void> done) : _done(std::move(done)) {}
+
+    /**
+     * @return true if data has been written and synced to disk
+     */
+    bool ready() const { return !_done.valid() || _done.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+    /**
+     * Wait until data is written and synced to disk. Rethrows I/O errors of the background thread.
+     */
+    void wait() const {
+      if (_done.valid()) _done.get();
+    }
+
+  private:
+    std::shared_future<void> _done;
+  };
+
+  /**
+   * @brief Asynchronous checkpoint writer.
+   *
+   * Data is copied into a staging buffer and the call returns immediately, a dedicated I/O thread writes staged data
+   * and syncs it to disk while computation continues. Total size of staged data is limited by the staging budget:
+   * a request that does not fit waits until earlier requests are written. A request larger than the budget is
+   * accepted when nothing else is staged. Staging buffers are borrowed from the global buffer pool.
+   */
+  class async_checkpoint {
+    struct job_t {
+      std::string             filename;
+      uint64_t                offset;
+      uint64_t                file_size;
+      pooled_buffer<char>     buffer;
+      size_t                  bytes;
+      std::promise<void>      done;
+    };
+
+  public:
+    /**
+     * @param staging_budget - maximal size of staged data in bytes
+     */
+    explicit async_checkpoint(size_t staging_budget = size_t(1) << 30) :
+        _budget(staging_budget), _worker([this] { run(); }) {}
+
+    /**
+     * Limit staged data to the per-process share of the node memory budget of the context.
+     *
+     * @param ctx - MPI context
+     */
+    explicit async_checkpoint(const mpi_context& ctx) : async_checkpoint(std::min(size_t(1) << 30, ctx.temporary_budget())) {}
+
+    async_checkpoint(const async_checkpoint&)            = delete;
+    async_checkpoint& operator=(const async_checkpoint&) = delete;
+
+    ~async_checkpoint() {
+      {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+      }
+      _cv.notify_all();
+      _worker.join();
+    }
+
+    /**
+     * Snapshot array and schedule writing it into a file.
+     *
+     * @tparam T - trivially copyable element type
+     * @param filename - name of the file
+     * @param data - array to save
+     * @param count - number of elements
+     * @param offset - position in the file in bytes
+     * @param file_size - size the file is truncated or extended to, 0 keeps the current size
+     * @return completion handle
+     */
+    template <typename T>
+    checkpoint_handle submit(const std::string& filename, const T* data, size_t count, uint64_t offset = 0,
+                             uint64_t file_size = 0) {
+      static_assert(std::is_trivially_copyable_v<T>, "Checkpointed data should be trivially copyable.");
+      size_t bytes = count * sizeof(T);
+      double start = MPI_Wtime();
+      {
+        std::unique_lock lock(_mutex);
+        _cv.wait(lock, [this, bytes] { return _staged == 0 || _staged + bytes <= _budget; });
+        _staged += bytes;
+      }
+      double              staged = MPI_Wtime();
+      pooled_buffer<char> buffer(bytes);
+      std::memcpy(buffer.data(), data, bytes);
+      auto                job = std::make_unique<job_t>(job_t{filename, offset, file_size, std::move(buffer), bytes, {}});
+      checkpoint_handle   handle(job->done.get_future().share());
+      {
+        std::lock_guard lock(_mutex);
+        _queue.push_back(std::move(job));
+        _stall_time += staged - start;
+        _snapshot_time += MPI_Wtime() - staged;
+      }
+      _cv.notify_all();
+      return handle;
+    }
+
+    /**
+     * Snapshot shared object and schedule writing it into a file. Every process of the node copies and writes its own
+     * part of the shared data, so the node writes its shared data once and in parallel. Collective over the node
+     * communicator; shared data can be modified after the call returns on all processes of the node.
+     *
+     * @tparam Shared - type of shared data access object
+     * @param filename - name of the file, processes of different nodes should use different files
+     * @param shared - shared object to save
+     * @param ctx - MPI context the shared object is allocated in
+     * @return completion handle of the local part
+     */
+    template <typename Shared>
+    checkpoint_handle submit(const std::string& filename, shared_object<Shared>& shared, mpi_context& ctx) {
+      using T       = typename Shared::value_type;
+      size_t count  = shared.size();
+      size_t lo     = count * ctx.node_rank / ctx.node_size;
+      size_t hi     = count * (ctx.node_rank + 1) / ctx.node_size;
+      auto   handle = submit(filename, shared.object().data() + lo, hi - lo, lo * sizeof(T), count * sizeof(T));
+      ctx.barrier().wait();
+      return handle;
+    }
+
+    /**
+     * Wait until all scheduled requests are written.
+     */
+    void wait_all() {
+      double           start = MPI_Wtime();
+      std::unique_lock lock(_mutex);
+      _cv.wait(lock, [this] { return _queue.empty() && _staged == 0; });
+      _stall_time += MPI_Wtime() - start;
+    }
+
+    /**
+     * Add checkpoint statistics collected since the previous report to the timing object. Background write time that
+     * was not spent waiting by the caller is reported as hidden I/O.
+     *
+     * @param statistic - timing object
+     */
+    void report(timing& statistic) {
+      std::lock_guard lock(_mutex);
+      statistic.event("CHECKPOINT SNAPSHOT").duration += _snapshot_time;
+      statistic.event("CHECKPOINT STALL").duration += _stall_time;
+      statistic.event("CHECKPOINT BACKGROUND WRITE").duration += _write_time;
+      statistic.event("CHECKPOINT HIDDEN I/O").duration += std::max(0.0, _write_time - _stall_time);
+      _snapshot_time = _stall_time = _write_time = 0.0;
+    }
+
+    size_t staged_bytes() const {
+      std::lock_guard lock(_mutex);
+      return _staged;
+    }
+
+  private:
+    size_t                             _budget;
+    size_t                             _staged        = 0;
+    bool                               _stop          = false;
+    double                             _snapshot_time = 0.0;
+    double                             _stall_time    = 0.0;
+    double                             _write_time    = 0.0;
+    std::deque<std::unique_ptr<job_t>> _queue;
+    mutable std::mutex                 _mutex;
+    std::condition_variable            _cv;
+    std::thread                        _worker;
+
+    void run() {
+      bound_thread binding;
+      while (true) {
+        std::unique_ptr<job_t> job;
+        {
+          std::unique_lock lock(_mutex);
+          _cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+          if (_queue.empty()) return;
+          job = std::move(_queue.front());
+          _queue.pop_front();
+        }
+        auto start = std::chrono::steady_clock::now();
+        try {
+          write(*job);
+          job->done.set_value();
+        } catch (...) {
+          job->done.set_exception(std::current_exception());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        {
+          std::lock_guard lock(_mutex);
+          _staged -= job->bytes;
+          _write_time += elapsed.count();
+        }
+        _cv.notify_all();
+      }
+    }
+
+    static void write(const job_t& job) {
+      int fd = ::open(job.filename.c_str(), O_WRONLY | O_CREAT, 0644);
+      if (fd < 0) throw mpi_io_error("Failed to open checkpoint file " + job.filename + ".");
+      bool        ok   = !job.file_size || ::ftruncate(fd, job.file_size) == 0;
+      const char* data = job.buffer.data();
+      size_t      left = job.bytes;
+      off_t       pos  = job.offset;
+      while (ok && left > 0) {
+        ssize_t n = ::pwrite(fd, data, left, pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          ok = false;
+          break;
+        }
+        data += n;
+        left -= n;
+        pos += n;
+      }
+      ok = ok && ::fsync(fd) == 0;
+      ::close(fd);
+      if (!ok) throw mpi_io_error("Failed to write checkpoint file " + job.filename + ".");
+    }
+  };
+
+  namespace detail {
+    /**
+     * 64-bit FNV-1a hash of a memory region
+     */
+    inline uint64_t block_hash(const void* data, size_t bytes) {
+      const unsigned char* p    = static_cast<const unsigned char*>(data);
+      uint64_t             hash = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+      }
+      return hash;
+    }
+
+    /**
+     * Write sequence of memory segments into a new file and sync it to disk.
+     */
+    inline void write_synced(const std::string& filename, const std::vector<std::pair<const char*, size_t>>& segments) {
+      int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) throw mpi_io_error("Failed to open checkpoint file " + filename + ".");
+      bool ok = true;
+      for (auto [data, bytes] : segments) {
+        while (ok && bytes > 0) {
+          ssize_t n = ::write(fd, data, bytes);
+          if (n < 0 && errno == EINTR) continue;
+          ok = n > 0;
+          if (ok) {
+            data += n;
+            bytes -= n;
+          }
+        }
+      }
+      ok = ok && ::fsync(fd) == 0;
+      ::close(fd);
+      if (!ok) throw mpi_io_error("Failed to write checkpoint file " + filename + ".");
+    }
+  }  // namespace detail
+
+  /**
+   * @brief Incremental checkpoint of a large array.
+   *
+   * Array is split into fixed-size blocks. The first checkpoint (level 0) stores all blocks, every following level
+   * stores only blocks that changed since the previous level, together with a manifest listing stored blocks and their
+   * hashes. Changes are detected by hashing blocks and/or through explicit `mark_dirty` calls. Array is restored by
+   * applying the base level followed by the chain of increments.
+   *
+   * Level `n` is stored in files `<prefix>.<n>.manifest` and `<prefix>.<n>.bin`. Shared objects are stored once per node
+   * in files `<prefix>.node<k>.<n>.manifest` and `<prefix>.node<k>.<n>.bin`, where `k` is the internode rank of the node,
+   * so that node leaders do not overwrite each other on a shared file system.
+   *
+   * @tparam T - trivially copyable element type
+   */
+  template <typename T>
+  class incremental_checkpoint {
+    static_assert(std::is_trivially_copyable_v<T>, "Checkpointed data should be trivially copyable.");
+
+  public:
+    struct manifest_header {
+      static constexpr uint64_t signature = 0x54504b4349455247ull;  // "GREICKPT"
+
+      uint64_t magic = signature;
+      uint64_t level;
+      uint64_t count;
+      uint64_t block_size;
+      uint64_t element_size;
+      uint64_t nblocks;
+    };
+
+    /**
+     * @param prefix - prefix of checkpoint files
+     * @param count - number of elements in the array
+     * @param block_size - number of elements in a block
+     * @param use_hashes - detect modified blocks by hashing, otherwise only blocks marked dirty are stored
+     */
+    incremental_checkpoint(std::string prefix, size_t count, size_t block_size, bool use_hashes = true) :
+        _prefix(std::move(prefix)), _count(count), _block_size(block_size), _use_hashes(use_hashes),
+        _nblocks((count + block_size - 1) / block_size), _hashes(_nblocks, 0), _dirty(_nblocks, 1) {}
+
+    /**
+     * Mark elements [offset, offset + count) as modified.
+     */
+    void mark_dirty(size_t offset, size_t count) {
+      if (count == 0) return;
+      for (size_t b = offset / _block_size; b <= (offset + count - 1) / _block_size && b < _nblocks; ++b) _dirty[b] = 1;
+    }
+
+    /**
+     * Store blocks modified since the previous level.
+     *
+     * @param data - array data
+     * @return number of stored blocks
+     */
+    size_t save(const T* data) {
+      // marks and hashes are kept for the next attempt if the level cannot be written
+      std::vector<uint64_t>      hashes = _hashes;
+      std::vector<unsigned char> dirty  = _dirty;
+      try {
+        return write_level(_prefix, data, changed_blocks(data, 0, _nblocks));
+      } catch (const mpi_io_error&) {
+        _hashes = std::move(hashes);
+        _dirty  = std::move(dirty);
+        throw;
+      }
+    }
+
+    /**
+     * Store blocks of a shared object modified since the previous level. Blocks marked dirty on any process of the node
+     * are combined, then every process checks its own range of blocks and the node leader writes the increment, so each
+     * node writes its shared data once. Collective over the node communicator.
+     *
+     * @tparam Shared - type of shared data access object
+     * @param shared - shared object with `count` elements
+     * @param ctx - MPI context the shared object is allocated in
+     * @return number of blocks stored by the node
+     */
+    template <typename Shared>
+    size_t save(shared_object<Shared>& shared, mpi_context& ctx) {
+      // all writes into the shared data are finished before it is hashed
+      ctx.barrier().wait();
+      MPI_Allreduce(MPI_IN_PLACE, _dirty.data(), _nblocks, MPI_UNSIGNED_CHAR, MPI_LOR, ctx.node_comm);
+      // marks and hashes are kept for the next attempt if the leader fails to write the level
+      std::vector<uint64_t>      hashes = _hashes;
+      std::vector<unsigned char> dirty  = _dirty;
+      const T*                   data   = shared.object().data();
+      size_t                     lo     = _nblocks * ctx.node_rank / ctx.node_size;
+      size_t                     hi     = _nblocks * (ctx.node_rank + 1) / ctx.node_size;
+      std::vector<uint64_t>      local;
+      for (size_t b : changed_blocks(data, lo, hi)) local.insert(local.end(), {b, _hashes[b]});
+      // leader collects (block, hash) pairs of the whole node
+      int              n = static_cast<int>(local.size());
+      std::vector<int> counts(ctx.node_size), displs(ctx.node_size, 0);
+      MPI_Gather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, ctx.node_comm);
+      for (int r = 1; r < ctx.node_size; ++r) displs[r] = displs[r - 1] + counts[r - 1];
+      std::vector<uint64_t> all(ctx.node_rank ? 0 : displs.back() + counts.back());
+      MPI_Gatherv(local.data(), n, MPI_UINT64_T, all.data(), counts.data(), displs.data(), MPI_UINT64_T, 0, ctx.node_comm);
+      size_t stored = 0;
+      int    ok     = 1;
+      if (!ctx.node_rank) {
+        std::vector<size_t> blocks;
+        for (size_t i = 0; i < all.size(); i += 2) {
+          blocks.push_back(all[i]);
+          _hashes[all[i]] = all[i + 1];
+        }
+        try {
+          stored = write_level(node_prefix(ctx), data, blocks);
+        } catch (const mpi_io_error&) {
+          ok = 0;
+        }
+      }
+      MPI_Bcast(&ok, 1, MPI_INT, 0, ctx.node_comm);
+      if (!ok) {
+        _hashes = std::move(hashes);
+        _dirty  = std::move(dirty);
+        throw mpi_io_error("Failed to write incremental checkpoint " + node_prefix(ctx) + ".");
+      }
+      // marks outside of the own range have been taken into account by the processes checking them
+      std::fill(_dirty.begin(), _dirty.end(), 0);
+      // leader advances its level in `write_level`
+      if (ctx.node_rank) ++_level;
+      return stored;
+    }
+
+    /**
+     * Restore array from the base level and the chain of increments up to `level`. Subsequent `save` continues the chain.
+     *
+     * @param data - array to restore
+     * @param level - last level to apply, all stored levels by default
+     */
+    void restore(T* data, size_t level = std::numeric_limits<size_t>::max()) { restore_files(_prefix, data, level); }
+
+    /**
+     * Restore shared object on the node leader, collective over the node communicator.
+     */
+    template <typename Shared>
+    void restore(shared_object<Shared>& shared, mpi_context& ctx, size_t level = std::numeric_limits<size_t>::max()) {
+      int ok = 1;
+      if (!ctx.node_rank) {
+        try {
+          restore_files(node_prefix(ctx), shared.object().data(), level);
+        } catch (const mpi_io_error&) {
+          ok = 0;
+        }
+      }
+      unsigned long state[2] = {static_cast<unsigned long>(ok), _level};
+      MPI_Bcast(state, 2, MPI_UNSIGNED_LONG, 0, ctx.node_comm);
+      if (!state[0]) throw mpi_io_error("Failed to restore incremental checkpoint " + node_prefix(ctx) + ".");
+      _level = state[1];
+      MPI_Bcast(_hashes.data(), _nblocks, MPI_UINT64_T, 0, ctx.node_comm);
+      std::fill(_dirty.begin(), _dirty.end(), 0);
+      ctx.barrier().wait();
+    }
+
+    size_t level() const { return _level; }
+    size_t nblocks() const { return _nblocks; }
+
+  private:
+    std::string                _prefix;
+    size_t                     _count;
+    size_t                     _block_size;
+    bool                       _use_hashes;
+    size_t                     _nblocks;
+    size_t                     _level = 0;
+    std::vector<uint64_t>      _hashes;
+    std::vector<unsigned char> _dirty;
+
+    size_t block_elements(size_t b) const { return std::min(_block_size, _count - b * _block_size); }
+
+    static std::string file_name(const std::string& prefix, size_t level, const std::string& ext) {
+      return prefix + "." + std::to_string(level) + "." + ext;
+    }
+
+    // shared objects are stored per node
+    std::string node_prefix(const mpi_context& ctx) const { return _prefix + ".node" + std::to_string(ctx.internode_rank); }
+
+    // blocks in [lo, hi) that changed since the previous level, updates stored hashes
+    std::vector<size_t> changed_blocks(const T* data, size_t lo, size_t hi) {
+      std::vector<size_t> blocks;
+      for (size_t b = lo; b < hi; ++b) {
+        bool     changed = _level == 0 || _dirty[b];
+        uint64_t hash    = _hashes[b];
+        if (_use_hashes || changed) {
+          hash = detail::block_hash(data + b * _block_size, block_elements(b) * sizeof(T));
+          changed |= _use_hashes && hash != _hashes[b];
+        }
+        if (changed) {
+          blocks.push_back(b);
+          _hashes[b] = hash;
+        }
+        _dirty[b] = 0;
+      }
+      return blocks;
+    }
+
+    // apply base level and increments stored in files with the given prefix
+    void restore_files(const std::string& prefix, T* data, size_t level) {
+      size_t l = 0;
+      for (; l <= level; ++l) {
+        std::ifstream manifest(file_name(prefix, l, "manifest"), std::ios::binary);
+        if (!manifest) break;
+        manifest_header header;
+        manifest.read(reinterpret_cast<char*>(&header), sizeof(header));
+        // a level stores at most every block of the array once
+        if (!manifest || header.magic != manifest_header::signature || header.level != l || header.count != _count ||
+            header.block_size != _block_size || header.element_size != sizeof(T) || header.nblocks > _nblocks)
+          throw mpi_io_error("Checkpoint manifest " + file_name(prefix, l, "manifest") + " mismatches array.");
+        std::vector<uint64_t> entries(2 * header.nblocks);
+        manifest.read(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(uint64_t));
+        if (!manifest) throw mpi_io_error("Checkpoint manifest " + file_name(prefix, l, "manifest") + " is truncated.");
+        for (size_t i = 0; i < header.nblocks; ++i) {
+          if (entries[2 * i] >= _nblocks)
+            throw mpi_io_error("Checkpoint manifest " + file_name(prefix, l, "manifest") + " refers to a block out of range.");
+        }
+        std::ifstream blocks(file_name(prefix, l, "bin"), std::ios::binary);
+        for (size_t i = 0; i < header.nblocks; ++i) {
+          size_t b = entries[2 * i];
+          blocks.read(reinterpret_cast<char*>(data + b * _block_size), block_elements(b) * sizeof(T));
+          _hashes[b] = entries[2 * i + 1];
+        }
+        if (!manifest || !blocks) throw mpi_io_error("Failed to read checkpoint level " + std::to_string(l) + ".");
+      }
+      if (l == 0) throw mpi_io_error("Checkpoint " + prefix + " does not exist.");
+      _level = l;
+      std::fill(_dirty.begin(), _dirty.end(), 0);
+    }
+
+    size_t write_level(const std::string& prefix, const T* data, const std::vector<size_t>& blocks) {
+      manifest_header header;
+      header.level        = _level;
+      header.count        = _count;
+      header.block_size   = _block_size;
+      header.element_size = sizeof(T);
+      header.nblocks      = blocks.size();
+      std::vector<char> manifest(sizeof(header) + 2 * blocks.size() * sizeof(uint64_t));
+      std::memcpy(manifest.data(), &header, sizeof(header));
+      uint64_t* entries = reinterpret_cast<uint64_t*>(manifest.data() + sizeof(header));
+      std::vector<std::pair<const char*, size_t>> content;
+      for (size_t i = 0; i < blocks.size(); ++i) {
+        entries[2 * i]     = blocks[i];
+        entries[2 * i + 1] = _hashes[blocks[i]];
+        const char* block  = reinterpret_cast<const char*>(data + blocks[i] * _block_size);
+        content.emplace_back(block, block_elements(blocks[i]) * sizeof(T));
+      }
+      // data is written before the manifest, so that an interrupted write does not leave a valid level behind
+      detail::write_synced(file_name(prefix, _level, "bin"), content);
+      detail::write_synced(file_name(prefix, _level, "manifest"), {{manifest.data(), manifest.size()}});
+      ++_level;
+      return blocks.size();
+    }
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_CHECKPOINT_H
@@ -42,6 +42,10 @@ namespace green::utils {
   public:
     explicit mpi_communication_error(const std::string& what) : std::runtime_error(what) {}
   };
+  class mpi_io_error : public std::runtime_error {
+  public:
+    explicit mpi_io_error(const std::string& what) : std::runtime_error(what) {}
+  };
 }  // namespace green::utils
 
 #endif  // UTILS_EXCEPT_H
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_LOGGER_H
+#define GREEN_UTILS_LOGGER_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  enum class log_level { debug = 0, info = 1, warning = 2, error = 3 };
+
+  /**
+   * @brief Rank-filtered buffered logger.
+   *
+   * Messages are written only by processes that pass the rank and node filters (by default only rank 0 writes) and only
+   * if their level is not lower than the logger level. Filtered messages cost one comparison, arguments are not formatted.
+   * Accepted messages are buffered in memory and written to stdout (or to a per-rank file) when the buffer exceeds its
+   * threshold, on `flush()`, on error messages and on destruction.
+   *
+   * In aggregation mode messages are kept until the collective `collect()` call that gathers them on the root and
+   * prints identical messages of different processes once, e.g. "rank 0-511: message".
+   */
+  class logger {
+  public:
+    /**
+     * Global logger
+     */
+    static logger& get_instance() {
+      static logger instance;
+      return instance;
+    }
+
+    logger() = default;
+
+    logger(const logger&)            = delete;
+    logger& operator=(const logger&) = delete;
+
+    ~logger() { flush(); }
+
+    /**
+     * Set rank and node index of the current process from the communicator, the communicator is used as a default one
+     * by `collect()`. Collective over `comm`.
+     */
+    void setup(MPI_Comm comm) {
+      _comm = comm;
+      MPI_Comm_rank(comm, &_rank);
+      _node   = node_ids(comm)[_rank];
+      _active = -1;
+    }
+
+    void set_level(log_level level) { _level = level; }
+
+    /**
+     * @param ranks - ranks that write messages, empty list enables all ranks
+     */
+    void set_ranks(std::vector<int> ranks) {
+      _ranks  = std::move(ranks);
+      _active = -1;
+    }
+
+    /**
+     * @param nodes - indices of nodes whose processes write messages, empty list enables all nodes. Requires `setup()`.
+     */
+    void set_nodes(std::vector<int> nodes) {
+      _nodes  = std::move(nodes);
+      _active = -1;
+    }
+
+    /**
+     * @param bytes - size of buffered messages that triggers writing
+     */
+    void set_buffer_size(size_t bytes) { _buffer_size = bytes; }
+
+    /**
+     * Write messages into `<prefix>.<rank>.log` instead of stdout, empty prefix switches back to stdout.
+     */
+    void set_file(const std::string& prefix) {
+      std::lock_guard lock(_mutex);
+      write_buffer();
+      _prefix = prefix;
+      _file.close();
+    }
+
+    /**
+     * Keep messages until `collect()` to merge identical messages of different processes.
+     */
+    void set_aggregate(bool aggregate) { _aggregate = aggregate; }
+
+    /**
+     * @return true if message of the given level would be written by the current process
+     */
+    bool enabled(log_level level) {
+      if (level < _level) return false;
+      if (_active < 0) update_active();
+      return _active;
+    }
+
+    template <typename... Args>
+    void log(log_level level, const Args&... args) {
+      if (!enabled(level)) return;
+      std::ostringstream ss;
+      (ss << ... << args);
+      std::lock_guard lock(_mutex);
+      _buffer.push_back(ss.str());
+      _buffered += _buffer.back().size();
+      if (level == log_level::error || (!_aggregate && _buffered >= _buffer_size)) write_buffer();
+    }
+
+    template <typename... Args>
+    void debug(const Args&... args) {
+      log(log_level::debug, args...);
+    }
+    template <typename... Args>
+    void info(const Args&... args) {
+      log(log_level::info, args...);
+    }
+    template <typename... Args>
+    void warning(const Args&... args) {
+      log(log_level::warning, args...);
+    }
+    template <typename... Args>
+    void error(const Args&... args) {
+      log(log_level::error, args...);
+    }
+
+    /**
+     * Write buffered messages of the current process.
+     */
+    void flush() {
+      std::lock_guard lock(_mutex);
+      write_buffer();
+    }
+
+    /**
+     * Gather buffered messages on the root of the communicator and print each distinct message once together with the
+     * ranks that produced it. Collective over `comm`.
+     */
+    void collect(MPI_Comm comm) {
+      int rank, size;
+      MPI_Comm_rank(comm, &rank);
+      MPI_Comm_size(comm, &size);
+      std::string local;
+      {
+        std::lock_guard lock(_mutex);
+        for (auto& message : _buffer) local += message + '\0';
+        _buffer.clear();
+        _buffered = 0;
+      }
+      int              length = local.size();
+      std::vector<int> lengths(size), displs(size, 0);
+      MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+      std::string all;
+      if (!rank) {
+        for (int p = 1; p < size; ++p) displs[p] = displs[p - 1] + lengths[p - 1];
+        all.resize(displs[size - 1] + lengths[size - 1]);
+      }
+      MPI_Gatherv(local.data(), length, MPI_CHAR, all.data(), lengths.data(), displs.data(), MPI_CHAR, 0, comm);
+      if (rank) return;
+      // distinct messages in order of first appearance with ranks that produced them
+      std::vector<std::pair<std::string, std::vector<int>>> messages;
+      std::map<std::string, size_t>                         index;
+      for (int p = 0; p < size; ++p) {
+        for (size_t pos = displs[p], end = displs[p] + lengths[p]; pos < end;) {
+          size_t      stop    = all.find('\0', pos);
+          std::string message = all.substr(pos, stop - pos);
+          pos                 = stop + 1;
+          auto [it, inserted] = index.emplace(message, messages.size());
+          if (inserted) messages.emplace_back(message, std::vector<int>{});
+          auto& ranks = messages[it->second].second;
+          if (ranks.empty() || ranks.back() != p) ranks.push_back(p);
+        }
+      }
+      std::ostringstream ss;
+      for (auto& [message, ranks] : messages) ss << "rank " << rank_ranges(ranks) << ": " << message << '\n';
+      std::lock_guard lock(_mutex);
+      sink() << ss.str() << std::flush;
+    }
+
+    /**
+     * Collective over the communicator set by `setup()` (MPI_COMM_WORLD by default).
+     */
+    void collect() { collect(_comm); }
+
+    /**
+     * Compact representation of a sorted list of ranks, e.g. "0-3,8,10-11".
+     */
+    static std::string rank_ranges(const std::vector<int>& ranks) {
+      std::ostringstream ss;
+      for (size_t i = 0; i < ranks.size();) {
+        size_t j = i;
+        while (j + 1 < ranks.size() && ranks[j + 1] == ranks[j] + 1) ++j;
+        ss << (i ? "," : "") << ranks[i];
+        if (j > i) ss << "-" << ranks[j];
+        i = j + 1;
+      }
+      return ss.str();
+    }
+
+  private:
+    MPI_Comm                 _comm        = MPI_COMM_WORLD;
+    int                      _rank        = -1;
+    int                      _node        = -1;
+    // -1 when filters have to be re-evaluated
+    int                      _active      = -1;
+    log_level                _level       = log_level::info;
+    std::vector<int>         _ranks       = {0};
+    std::vector<int>         _nodes;
+    size_t                   _buffer_size = size_t(1) << 16;
+    bool                     _aggregate   = false;
+    std::string              _prefix;
+    std::ofstream            _file;
+    std::vector<std::string> _buffer;
+    size_t                   _buffered = 0;
+    std::mutex               _mutex;
+
+    void update_active() {
+      if (_rank < 0) {
+        int initialized;
+        MPI_Initialized(&initialized);
+        // rank is unknown before MPI is initialized
+        if (!initialized) {
+          _active = _ranks.empty() || std::find(_ranks.begin(), _ranks.end(), 0) != _ranks.end();
+          return;
+        }
+        MPI_Comm_rank(MPI_COMM_WORLD, &_rank);
+      }
+      bool rank_ok = _ranks.empty() || std::find(_ranks.begin(), _ranks.end(), _rank) != _ranks.end();
+      bool node_ok = _nodes.empty() || std::find(_nodes.begin(), _nodes.end(), _node) != _nodes.end();
+      _active      = rank_ok && node_ok;
+    }
+
+    std::ostream& sink() {
+      if (_prefix.empty()) return std::cout;
+      if (!_file.is_open()) _file.open(_prefix + "." + std::to_string(std::max(_rank, 0)) + ".log", std::ios::app);
+      return _file;
+    }
+
+    void write_buffer() {
+      if (_buffer.empty()) return;
+      std::ostringstream ss;
+      for (auto& message : _buffer) ss << "[rank " << std::max(_rank, 0) << "] " << message << '\n';
+      _buffer.clear();
+      _buffered = 0;
+      sink() << ss.str() << std::flush;
+    }
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_LOGGER_H
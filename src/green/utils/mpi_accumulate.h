@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_ACCUMULATE_H
+#define GREEN_UTILS_MPI_ACCUMULATE_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Distributed array that accumulates sparse contributions of all processes.
+   *
+   * Array is split in contiguous slabs between nodes, the slab of a node is stored once in node shared memory. Processes
+   * add blocks at arbitrary global positions with `accumulate`:
+   *   - parts of a block that belong to the own node are added directly into shared memory under striped locks;
+   *   - parts that belong to other nodes are batched per owner node.
+   * The collective `flush()` sends each batch with a single `MPI_Accumulate` to the node leader of the owner within a
+   * passive-target epoch, overlapping contributions of a process are combined beforehand. Remote updates are applied
+   * only inside `flush()`, so they never mix with direct shared memory updates. Node slabs can be read after `flush()`;
+   * processes should synchronize before accumulating again.
+   *
+   * @tparam T - arithmetic element type with a predefined MPI datatype
+   */
+  template <typename T>
+  class distributed_array {
+    static_assert(std::atomic<int>::is_always_lock_free, "Striped locks require lock-free atomics.");
+
+    // lock padded to a cache line
+    struct alignas(cache_line_size) lock_t {
+      std::atomic<int> flag;
+    };
+
+    // contribution batched for a remote node: target offset in the node slab, length and offset in the data buffer
+    struct entry_t {
+      size_t target;
+      size_t count;
+      size_t offset;
+    };
+
+    struct batch_t {
+      std::vector<entry_t> entries;
+      std::vector<T>       data;
+    };
+
+  public:
+    /**
+     * Allocate zero-initialized array. Collective over `ctx.global`.
+     *
+     * @param size - global number of elements
+     * @param ctx - MPI context
+     * @param stripe - number of consecutive elements protected by the same lock
+     * @param nlocks - number of locks per node
+     */
+    distributed_array(size_t size, mpi_context& ctx, size_t stripe = 1024, size_t nlocks = 64) :
+        _size(size), _ctx(ctx), _stripe(std::max<size_t>(stripe, 1)), _nlocks(std::max<size_t>(nlocks, 1)),
+        _batches(ctx.internode_size) {
+      _node  = ctx.internode_rank;
+      _begin = slab_begin(_node);
+      _end   = slab_begin(_node + 1);
+      // locks are stored in front of the node slab
+      size_t locks_bytes = _nlocks * sizeof(lock_t);
+      size_t bytes       = ctx.node_rank ? 0 : locks_bytes + (_end - _begin) * sizeof(T);
+      void*  ptr;
+      if (MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, ctx.node_comm, &ptr, &_shm_win) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed allocating shared memory for distributed array.");
+      MPI_Aint shm_size;
+      int      disp_unit;
+      if (MPI_Win_shared_query(_shm_win, 0, &shm_size, &disp_unit, &ptr) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed extracting pointer to the distributed array slab.");
+      _locks = static_cast<lock_t*>(ptr);
+      _data  = reinterpret_cast<T*>(static_cast<char*>(ptr) + locks_bytes);
+      if (!ctx.node_rank) {
+        for (size_t i = 0; i < _nlocks; ++i) new (_locks + i) lock_t{{0}};
+        std::fill(_data, _data + (_end - _begin), T(0));
+      }
+      // node leaders expose their slabs to the remote processes, on a single node all updates go through shared memory
+      if (ctx.internode_size > 1) {
+        if (MPI_Win_create(_data, ctx.node_rank ? 0 : (_end - _begin) * sizeof(T), sizeof(T), MPI_INFO_NULL, ctx.global,
+                           &_rma_win) != MPI_SUCCESS)
+          throw mpi_communication_error("Failed creating window for distributed array.");
+        int              leader = ctx.node_rank ? -1 : ctx.global_rank;
+        std::vector<int> leaders(ctx.global_size);
+        MPI_Allgather(&leader, 1, MPI_INT, leaders.data(), 1, MPI_INT, ctx.global);
+        for (int l : leaders) {
+          if (l >= 0) _leaders.push_back(l);
+        }
+      }
+      MPI_Barrier(ctx.global);
+    }
+
+    distributed_array(const distributed_array&)            = delete;
+    distributed_array& operator=(const distributed_array&) = delete;
+
+    ~distributed_array() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (finalized) return;
+      if (_rma_win != MPI_WIN_NULL) MPI_Win_free(&_rma_win);
+      if (_shm_win != MPI_WIN_NULL) MPI_Win_free(&_shm_win);
+    }
+
+    /**
+     * Add block of contiguous elements to the array starting from the global index. Not collective.
+     *
+     * @param block - contribution
+     * @param count - number of elements in the block
+     * @param index - global index of the first element
+     */
+    void accumulate(const T* block, size_t count, size_t index) {
+      if (index + count > _size) throw mpi_communication_error("Block is out of range of distributed array.");
+      while (count > 0) {
+        int    node = owner(index);
+        size_t n    = std::min(count, slab_begin(node + 1) - index);
+        if (node == _node) {
+          add_local(block, n, index - _begin);
+        } else {
+          batch_t& batch = _batches[node];
+          batch.entries.push_back({index - slab_begin(node), n, batch.data.size()});
+          batch.data.insert(batch.data.end(), block, block + n);
+        }
+        block += n;
+        index += n;
+        count -= n;
+      }
+    }
+
+    void accumulate(const T& value, size_t index) { accumulate(&value, 1, index); }
+
+    /**
+     * Apply batched contributions to remote nodes. Collective over `ctx.global`, after the call all contributions made
+     * before it are visible in node slabs.
+     */
+    void flush() {
+      watchdog_guard guard("distributed_array::flush");
+      // all direct shared memory updates are finished before remote updates start
+      MPI_Barrier(_ctx.global);
+      if (_rma_win == MPI_WIN_NULL) return;
+      MPI_Win_lock_all(0, _rma_win);
+      std::vector<T> packed;
+      for (int node = 0; node < static_cast<int>(_batches.size()); ++node) {
+        batch_t& batch = _batches[node];
+        if (batch.entries.empty()) continue;
+        std::vector<int>      lengths;
+        std::vector<MPI_Aint> displs;
+        pack(batch, packed, lengths, displs);
+        MPI_Datatype target;
+        MPI_Type_create_hindexed(lengths.size(), lengths.data(), displs.data(), mpi_type<T>::type, &target);
+        MPI_Type_commit(&target);
+        int status = MPI_Accumulate(packed.data(), static_cast<int>(packed.size()), mpi_type<T>::type, _leaders[node], 0, 1,
+                                    target, MPI_SUM, _rma_win);
+        // freeing the datatype does not affect the pending operation
+        MPI_Type_free(&target);
+        if (status != MPI_SUCCESS) throw mpi_communication_error("Remote accumulation into distributed array failed.");
+        MPI_Win_flush(_leaders[node], _rma_win);
+        batch.entries.clear();
+        batch.data.clear();
+      }
+      MPI_Win_unlock_all(_rma_win);
+      MPI_Barrier(_ctx.global);
+    }
+
+    /**
+     * Set all elements to zero. Collective over `ctx.global`.
+     */
+    void zero() {
+      MPI_Barrier(_ctx.global);
+      auto [begin, end] = node_share();
+      std::fill(_data + begin, _data + end, T(0));
+      for (auto& batch : _batches) {
+        batch.entries.clear();
+        batch.data.clear();
+      }
+      MPI_Barrier(_ctx.global);
+    }
+
+    /**
+     * @return index of the node that stores the element
+     */
+    int owner(size_t index) const {
+      int node = static_cast<int>((index * _batches.size()) / _size);
+      while (slab_begin(node + 1) <= index) ++node;
+      while (slab_begin(node) > index) --node;
+      return node;
+    }
+
+    size_t size() const { return _size; }
+    // global index range stored on the current node
+    size_t node_begin() const { return _begin; }
+    size_t node_end() const { return _end; }
+    // slab of the current node in shared memory
+    T*       node_data() { return _data; }
+    const T* node_data() const { return _data; }
+
+  private:
+    size_t               _size;
+    mpi_context&         _ctx;
+    size_t               _stripe;
+    size_t               _nlocks;
+    std::vector<batch_t> _batches;
+    int                  _node;
+    size_t               _begin;
+    size_t               _end;
+    lock_t*              _locks   = nullptr;
+    T*                   _data    = nullptr;
+    MPI_Win              _shm_win = MPI_WIN_NULL;
+    MPI_Win              _rma_win = MPI_WIN_NULL;
+    // global rank of the leader of each node
+    std::vector<int>     _leaders;
+
+    size_t slab_begin(int node) const { return (_size * node) / _batches.size(); }
+
+    // part of the node slab handled by the current process in node-wide operations
+    std::pair<size_t, size_t> node_share() const {
+      size_t n = _end - _begin;
+      return {(n * _ctx.node_rank) / _ctx.node_size, (n * (_ctx.node_rank + 1)) / _ctx.node_size};
+    }
+
+    void add_local(const T* block, size_t count, size_t offset) {
+      while (count > 0) {
+        size_t n    = std::min(count, _stripe - offset % _stripe);
+        auto&  lock = _locks[(offset / _stripe) % _nlocks].flag;
+        for (int i = 0; lock.exchange(1, std::memory_order_acquire); ++i) {
+          if (i >= 100) std::this_thread::yield();
+        }
+        T* __restrict dst = _data + offset;
+        for (size_t i = 0; i < n; ++i) dst[i] += block[i];
+        lock.store(0, std::memory_order_release);
+        block += n;
+        offset += n;
+        count -= n;
+      }
+    }
+
+    /**
+     * Combine batched contributions into non-overlapping sorted segments, as required for the target datatype.
+     */
+    static void pack(const batch_t& batch, std::vector<T>& packed, std::vector<int>& lengths, std::vector<MPI_Aint>& displs) {
+      std::vector<size_t> order(batch.entries.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(),
+                [&batch](size_t a, size_t b) { return batch.entries[a].target < batch.entries[b].target; });
+      packed.clear();
+      size_t seg_begin = 0, seg_end = 0, seg_start = 0;
+      for (size_t k : order) {
+        const entry_t& e = batch.entries[k];
+        if (lengths.empty() || e.target > seg_end) {
+          if (!lengths.empty()) lengths.back() = static_cast<int>(seg_end - seg_begin);
+          seg_begin = e.target;
+          seg_end   = e.target;
+          seg_start = packed.size();
+          lengths.push_back(0);
+          displs.push_back(static_cast<MPI_Aint>(e.target * sizeof(T)));
+        }
+        if (e.target + e.count > seg_end) {
+          packed.resize(packed.size() + e.target + e.count - seg_end, T(0));
+          seg_end = e.target + e.count;
+        }
+        if (seg_end - seg_begin > INT_MAX) throw mpi_communication_error("Accumulated segment exceeds int range.");
+        T*       dst = packed.data() + seg_start + (e.target - seg_begin);
+        const T* src = batch.data.data() + e.offset;
+        for (size_t i = 0; i < e.count; ++i) dst[i] += src[i];
+      }
+      if (!lengths.empty()) lengths.back() = static_cast<int>(seg_end - seg_begin);
+      if (packed.size() > INT_MAX) throw mpi_communication_error("Batch of distributed array exceeds int range.");
+    }
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_ACCUMULATE_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_BARRIER_H
+#define GREEN_UTILS_MPI_BARRIER_H
+
+#include <mpi.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+
+#include "except.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Sense-reversing barrier for processes that share memory.
+   *
+   * Barrier state lives in a small MPI shared memory window allocated on a node-local communicator, processes
+   * synchronize through atomic operations on that state without calling MPI. Waiting processes spin for `spin_count`
+   * iterations and then yield the core. By default processes spin only when every process of the node communicator can
+   * have a core of its own; on an oversubscribed node spinning only delays the processes that still have to arrive, so
+   * waiting processes yield right away.
+   *
+   * All stores made by a process before `wait()` are visible to every other process of the communicator after
+   * `wait()` returns, including stores into other shared memory windows of the same node.
+   */
+  class node_barrier {
+    static_assert(std::atomic<int>::is_always_lock_free, "Shared memory barrier requires lock-free atomics.");
+
+    // counter and sense flag are kept on separate cache lines
+    struct state_t {
+      alignas(64) std::atomic<int> count;
+      alignas(64) std::atomic<int> sense;
+    };
+
+  public:
+    static constexpr int default_spin_count = 1000;
+
+    /**
+     * Allocate barrier state on the 0-th process of the node communicator. Collective over `comm`.
+     *
+     * @param comm - communicator of processes sharing memory, MPI_COMM_NULL makes barrier a no-op
+     * @param spin_count - number of busy-waiting iterations before yielding the core, negative value selects
+     *                     `default_spin_count` unless the node is oversubscribed
+     */
+    explicit node_barrier(MPI_Comm comm, int spin_count = -1) :
+        _comm(comm), _spin_count(spin_count < 0 ? default_spin_count : spin_count) {
+      if (_comm == MPI_COMM_NULL) return;
+      MPI_Comm_size(_comm, &_size);
+      if (_size == 1) return;
+      unsigned cores = std::thread::hardware_concurrency();
+      if (spin_count < 0 && cores && unsigned(_size) > cores) _spin_count = 0;
+      int rank;
+      MPI_Comm_rank(_comm, &rank);
+      void* ptr;
+      if (MPI_Win_allocate_shared(rank ? 0 : sizeof(state_t), 1, MPI_INFO_NULL, _comm, &ptr, &_win) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed allocating shared memory for node barrier.");
+      MPI_Aint size;
+      int      disp_unit;
+      if (MPI_Win_shared_query(_win, 0, &size, &disp_unit, &ptr) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed extracting pointer to the node barrier state.");
+      if (!rank) {
+        _state = new (ptr) state_t;
+        _state->count.store(_size);
+        _state->sense.store(0);
+      } else {
+        _state = static_cast<state_t*>(ptr);
+      }
+      MPI_Barrier(_comm);
+    }
+
+    node_barrier(const node_barrier&)            = delete;
+    node_barrier& operator=(const node_barrier&) = delete;
+
+    ~node_barrier() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (!finalized && _win != MPI_WIN_NULL) MPI_Win_free(&_win);
+    }
+
+    /**
+     * Block until all processes of the node communicator have called `wait()`.
+     */
+    void wait() {
+      if (_size == 1) return;
+      _local_sense = 1 - _local_sense;
+      if (_state->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // last process to arrive resets the counter and releases everybody else
+        _state->count.store(_size, std::memory_order_relaxed);
+        _state->sense.store(_local_sense, std::memory_order_release);
+        return;
+      }
+      for (int i = 0; _state->sense.load(std::memory_order_acquire) != _local_sense; ++i) {
+        if (i >= _spin_count) std::this_thread::yield();
+      }
+    }
+
+    int size() const { return _size; }
+
+    int spin_count() const { return _spin_count; }
+
+  private:
+    MPI_Comm _comm;
+    int      _spin_count;
+    int      _size        = 1;
+    int      _local_sense = 0;
+    MPI_Win  _win         = MPI_WIN_NULL;
+    state_t* _state       = nullptr;
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_BARRIER_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef GREEN_UTILS_MPI_GRID_H
+#define GREEN_UTILS_MPI_GRID_H
+
+#include <mpi.h>
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "mpi_redistribute.h"
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Two-dimensional `rows x cols` grid of processes with row and column communicators.
+   *
+   * Processes are placed on the grid row by row in node order, hence when the number of columns divides the node size
+   * every grid row stays within a node. Matrices are distributed over the grid by a pair of one-dimensional layouts, one
+   * for matrix rows over grid rows and one for matrix columns over grid columns.
+   */
+  class process_grid {
+  public:
+    /**
+     * Choose grid shape for a matrix. Local blocks are kept as square as possible, i.e. `rows / cols` close to the matrix
+     * aspect ratio; shapes with grid rows not aligned to nodes are accepted only if they improve the ratio by more than
+     * a factor of two.
+     *
+     * @param nprocs - number of processes
+     * @param node_size - number of processes per node
+     * @param aspect - ratio of the number of matrix rows to the number of matrix columns
+     * @return number of grid rows and columns
+     */
+    static std::pair<int, int> choose_shape(int nprocs, int node_size, double aspect = 1.0) {
+      std::pair<int, int> best{nprocs, 1};
+      double              best_score = std::numeric_limits<double>::max();
+      for (int cols = 1; cols <= nprocs; ++cols) {
+        if (nprocs % cols) continue;
+        int    rows    = nprocs / cols;
+        bool   aligned = node_size % cols == 0 || cols % node_size == 0;
+        double score   = std::abs(std::log(double(rows) / cols / aspect)) + (aligned ? 0.0 : std::log(2.0));
+        if (score < best_score) {
+          best       = {rows, cols};
+          best_score = score;
+        }
+      }
+      return best;
+    }
+
+    /**
+     * Build grid of given shape. Collective over `ctx.global`.
+     *
+     * @param ctx - MPI context
+     * @param rows - number of grid rows
+     * @param cols - number of grid columns, `rows * cols` should be equal to `ctx.global_size`
+     */
+    process_grid(const mpi_context& ctx, int rows, int cols) : _rows(rows), _cols(cols) {
+      if (rows < 1 || cols < 1 || rows * cols != ctx.global_size)
+        throw mpi_communicator_error("Process grid shape does not match the number of processes.");
+      // grid rows are node aligned groups of `cols` processes, columns connect the same position in every row
+      _groups = ctx.split_groups(rows, group_placement::node_aligned);
+      _row    = _groups.group_index;
+      _col    = _groups.group_rank;
+      _ranks.resize(ctx.global_size);
+      int position = _row * _cols + _col;
+      MPI_Allgather(&position, 1, MPI_INT, _ranks.data(), 1, MPI_INT, ctx.global);
+      // invert positions into global ranks
+      std::vector<int> ranks(ctx.global_size);
+      for (int r = 0; r < ctx.global_size; ++r) ranks[_ranks[r]] = r;
+      _ranks = std::move(ranks);
+    }
+
+    /**
+     * Build grid with the shape chosen for a matrix of given aspect ratio. Collective over `ctx.global`.
+     *
+     * @param ctx - MPI context
+     * @param aspect - ratio of the number of matrix rows to the number of matrix columns
+     */
+    explicit process_grid(const mpi_context& ctx, double aspect = 1.0) :
+        process_grid(ctx, choose_shape(ctx.global_size, ctx.node_size, aspect)) {}
+
+    // distributions refer to the grid
+    process_grid(const process_grid&)            = delete;
+    process_grid& operator=(const process_grid&) = delete;
+
+    int rows() const { return _rows; }
+    int cols() const { return _cols; }
+    // grid coordinates of the current process
+    int row() const { return _row; }
+    int col() const { return _col; }
+
+    // processes of the grid row of the current process, ranked by grid column
+    MPI_Comm row_comm() const { return _groups.group_comm; }
+    // processes of the grid column of the current process, ranked by grid row
+    MPI_Comm col_comm() const { return _groups.cross_comm; }
+
+    /**
+     * @return rank in the global communicator of the process at grid coordinates `(row, col)`
+     */
+    int rank(int row, int col) const { return _ranks[row * _cols + col]; }
+
+    /**
+     * @brief Distribution of an `m x n` matrix over the grid.
+     */
+    struct distribution {
+      const process_grid* grid;
+      layout              row_layout;
+      layout              col_layout;
+
+      /**
+       * @return global rank of the owner of matrix element `(i, j)`
+       */
+      int owner(size_t i, size_t j) const { return grid->rank(row_layout.owner(i), col_layout.owner(j)); }
+
+      /**
+       * @return position of matrix element `(i, j)` in the local block of its owner
+       */
+      std::pair<size_t, size_t> local_index(size_t i, size_t j) const {
+        return {row_layout.local_index(i), col_layout.local_index(j)};
+      }
+
+      /**
+       * @return shape of the local block of the process at grid coordinates `(row, col)`
+       */
+      std::pair<size_t, size_t> local_shape(int row, int col) const {
+        return {row_layout.local_size(row), col_layout.local_size(col)};
+      }
+    };
+
+    /**
+     * Contiguous blocks of rows and columns
+     */
+    distribution block(size_t m, size_t n) const {
+      return distribution{this, layout::block(m, _rows), layout::block(n, _cols)};
+    }
+
+    /**
+     * Blocks of `mb x nb` elements dealt to grid rows and columns in round-robin order
+     */
+    distribution block_cyclic(size_t m, size_t n, size_t mb, size_t nb) const {
+      return distribution{this, layout::block_cyclic(m, _rows, mb), layout::block_cyclic(n, _cols, nb)};
+    }
+
+  private:
+    int              _rows;
+    int              _cols;
+    int              _row = 0;
+    int              _col = 0;
+    process_groups   _groups;
+    // global rank of every grid position
+    std::vector<int> _ranks;
+
+    process_grid(const mpi_context& ctx, std::pair<int, int> shape) : process_grid(ctx, shape.first, shape.second) {}
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_GRID_H
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_IO_H
+#define GREEN_UTILS_MPI_IO_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mpi_shared.h"
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  /**
+   * Header of a flat binary file with distributed array. Array data starts at `data_offset` bytes from the beginning of
+   * the file, that is aligned to the stripe size used for writing.
+   */
+  struct file_header {
+    static constexpr uint64_t signature = 0x4e49424e45455247ull;  // "GREENBIN"
+    static constexpr uint32_t current   = 1;
+
+    uint64_t magic   = signature;
+    uint32_t version = current;
+    uint32_t element_size;
+    uint64_t count;
+    uint64_t data_offset;
+  };
+
+  /**
+   * Parallel I/O tuning parameters.
+   */
+  struct io_options {
+    // number of I/O aggregators among node leaders (MPI-IO `cb_nodes` hint), 0 - all node leaders
+    int    aggregators  = 0;
+    // file system stripe size in bytes, array data is aligned to it
+    size_t stripe_size  = size_t(1) << 20;
+    // number of stripes (MPI-IO `striping_factor` hint), 0 - file system default
+    int    stripe_count = 0;
+  };
+
+  namespace detail {
+    inline MPI_Info io_info(const io_options& opts) {
+      MPI_Info info;
+      MPI_Info_create(&info);
+      MPI_Info_set(info, "romio_cb_write", "enable");
+      MPI_Info_set(info, "striping_unit", std::to_string(opts.stripe_size).c_str());
+      size_t buffer = std::max(opts.stripe_size, ((size_t(16) << 20) / opts.stripe_size) * opts.stripe_size);
+      MPI_Info_set(info, "cb_buffer_size", std::to_string(buffer).c_str());
+      if (opts.aggregators > 0) MPI_Info_set(info, "cb_nodes", std::to_string(opts.aggregators).c_str());
+      if (opts.stripe_count > 0) MPI_Info_set(info, "striping_factor", std::to_string(opts.stripe_count).c_str());
+      return info;
+    }
+
+    inline uint64_t data_offset(const io_options& opts) {
+      return ((sizeof(file_header) + opts.stripe_size - 1) / opts.stripe_size) * opts.stripe_size;
+    }
+
+    struct file_segment {
+      MPI_Aint offset;
+      int      length;
+    };
+
+    /**
+     * Read `bytes` bytes at `offset` of an open file, retrying on partial reads and interrupts.
+     */
+    inline void pread_all(int fd, char* buffer, size_t bytes, uint64_t offset, const std::string& filename) {
+      while (bytes > 0) {
+        ssize_t n = ::pread(fd, buffer, bytes, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw mpi_io_error("Failed to read from file " + filename + ".");
+        buffer += n;
+        bytes -= n;
+        offset += n;
+      }
+    }
+
+    /**
+     * Range [begin, end) of `count` elements assigned to `rank` out of `size` parts.
+     */
+    inline std::pair<size_t, size_t> split_range(size_t count, int rank, int size) {
+      return {count * rank / size, count * (rank + 1) / size};
+    }
+  }  // namespace detail
+
+  /**
+   * Collectively write distributed array into a flat binary file. Local pieces are stored one after another in the
+   * order of global ranks. Node leaders act as I/O aggregators: processes of a node copy their pieces into the node
+   * shared workspace and node leaders write staged data with collective MPI-IO calls over the internode communicator.
+   *
+   * @tparam T - trivially copyable element type
+   * @param filename - name of the file
+   * @param local - local piece of the array
+   * @param count - number of elements in the local piece
+   * @param ctx - MPI context
+   * @param opts - I/O tuning parameters
+   */
+  template <typename T>
+  void write_distributed(const std::string& filename, const T* local, size_t count, mpi_context& ctx,
+                         const io_options& opts = io_options()) {
+    watchdog_guard guard("write_distributed");
+    static_assert(std::is_trivially_copyable_v<T>, "Distributed write requires trivially copyable type.");
+    size_t total;
+    size_t offset = exscan(count, ctx.global, &total);
+    // file offsets of pieces of all node processes
+    std::vector<unsigned long> pieces(2 * ctx.node_size);
+    unsigned long              piece[2] = {offset, count};
+    MPI_Allgather(piece, 2, MPI_UNSIGNED_LONG, pieces.data(), 2, MPI_UNSIGNED_LONG, ctx.node_comm);
+    // position of the local piece in the node stream of pieces sorted by file offset
+    std::vector<int> order(ctx.node_size);
+    for (int r = 0; r < ctx.node_size; ++r) order[r] = r;
+    std::sort(order.begin(), order.end(), [&pieces](int a, int b) { return pieces[2 * a] < pieces[2 * b]; });
+    std::vector<size_t> stream(ctx.node_size + 1, 0);
+    for (int i = 0; i < ctx.node_size; ++i) stream[i + 1] = stream[i] + pieces[2 * order[i] + 1];
+    size_t node_count = stream[ctx.node_size];
+    size_t my_stream  = stream[std::find(order.begin(), order.end(), ctx.node_rank) - order.begin()];
+
+    size_t capacity = (ctx.workspace().size() / opts.stripe_size) * opts.stripe_size / sizeof(T);
+    if (capacity == 0) capacity = ctx.workspace().size() / sizeof(T);
+    if (capacity == 0) throw mpi_shared_memory_error("Shared workspace is too small for the distributed write.");
+    unsigned long rounds = (node_count + capacity - 1) / capacity;
+    MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_UNSIGNED_LONG, MPI_MAX, ctx.global);
+
+    uint64_t data_offset = detail::data_offset(opts);
+    MPI_File fh          = MPI_FILE_NULL;
+    // failures of node leaders are shared with all processes before throwing, so that nobody waits for them
+    int      ok          = 1;
+    if (!ctx.node_rank) {
+      MPI_Info info = detail::io_info(opts);
+      ok = MPI_File_open(ctx.internode_comm, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &fh) == MPI_SUCCESS;
+      MPI_Info_free(&info);
+      if (ok) ok = MPI_File_set_size(fh, data_offset + total * sizeof(T)) == MPI_SUCCESS;
+      if (ok && !ctx.global_rank) {
+        file_header header;
+        header.element_size = sizeof(T);
+        header.count        = total;
+        header.data_offset  = data_offset;
+        ok = MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+      }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ctx.global);
+    if (!ok) {
+      if (fh != MPI_FILE_NULL) MPI_File_close(&fh);
+      throw mpi_io_error("Failed to open file " + filename + " for writing.");
+    }
+
+    char* staging = ctx.workspace().as<char>();
+    for (size_t round = 0; round < rounds; ++round) {
+      size_t begin = round * capacity;
+      size_t end   = std::min(node_count, begin + capacity);
+      // copy part of the local piece that belongs to the current round
+      size_t lo    = std::max(begin, my_stream);
+      size_t hi    = std::min(end, my_stream + count);
+      if (lo < hi) std::memcpy(staging + (lo - begin) * sizeof(T), local + (lo - my_stream), (hi - lo) * sizeof(T));
+      ctx.barrier().wait();
+      if (!ctx.node_rank) {
+        std::vector<detail::file_segment> segments;
+        for (int i = 0; i < ctx.node_size; ++i) {
+          size_t plo = std::max(begin, stream[i]);
+          size_t phi = std::min(end, stream[i + 1]);
+          if (plo >= phi) continue;
+          MPI_Aint file_offset = data_offset + (pieces[2 * order[i]] + plo - stream[i]) * sizeof(T);
+          int      length      = static_cast<int>((phi - plo) * sizeof(T));
+          // pieces adjacent in the file are written as one segment
+          if (!segments.empty() && segments.back().offset + segments.back().length == file_offset) {
+            segments.back().length += length;
+          } else {
+            segments.push_back({file_offset, length});
+          }
+        }
+        std::vector<int>      lengths;
+        std::vector<MPI_Aint> displacements;
+        for (auto& s : segments) {
+          lengths.push_back(s.length);
+          displacements.push_back(s.offset);
+        }
+        MPI_Datatype filetype;
+        MPI_Type_create_hindexed(lengths.size(), lengths.data(), displacements.data(), MPI_BYTE, &filetype);
+        MPI_Type_commit(&filetype);
+        MPI_File_set_view(fh, 0, MPI_BYTE, segments.empty() ? MPI_BYTE : filetype, "native", MPI_INFO_NULL);
+        // collective write is called in every round even after a failure to keep leaders in step
+        int bytes = static_cast<int>((end > begin ? end - begin : 0) * sizeof(T));
+        if (MPI_File_write_all(fh, staging, bytes, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) ok = 0;
+        MPI_Type_free(&filetype);
+      }
+      ctx.barrier().wait();
+    }
+    if (!ctx.node_rank && MPI_File_close(&fh) != MPI_SUCCESS) ok = 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ctx.global);
+    if (!ok) throw mpi_io_error("Failed to write into file " + filename + ".");
+  }
+
+  /**
+   * Read header of a flat binary file written by `write_distributed`.
+   *
+   * @param filename - name of the file
+   * @return file header
+   */
+  inline file_header read_file_header(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw mpi_io_error("Failed to open file " + filename + " for reading.");
+    file_header header;
+    try {
+      detail::pread_all(fd, reinterpret_cast<char*>(&header), sizeof(header), 0, filename);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    if (header.magic != file_header::signature || header.version != file_header::current)
+      throw mpi_io_error("File " + filename + " is not a flat binary array file.");
+    return header;
+  }
+
+  /**
+   * Fill shared object with raw data from a file. Every process of the node reads a disjoint part of the data with
+   * `pread` straight into the shared memory. When `split_across_nodes` is set (file system is shared between nodes), each
+   * node reads only its part of the file and node leaders exchange parts over the internode communicator. Collective over
+   * the node communicator of the context of `dest`, or over its global communicator when `split_across_nodes` is set.
+   * Read errors are shared between these processes, so that all of them throw.
+   *
+   * @tparam Shared - type of shared data access object
+   * @param filename - name of the file
+   * @param offset - offset of the data in the file in bytes
+   * @param dest - shared object to fill, `dest.size()` elements are read
+   * @param split_across_nodes - read different parts of the file on different nodes
+   */
+  template <typename Shared>
+  void read_shared(const std::string& filename, uint64_t offset, shared_object<Shared>& dest, bool split_across_nodes = false) {
+    watchdog_guard guard("read_shared");
+    using T            = typename Shared::value_type;
+    mpi_context& ctx   = dest.ctx();
+    T*           data  = dest.object().data();
+    size_t       count = dest.size();
+    int          nodes = split_across_nodes ? ctx.internode_size : 1;
+    int          node  = split_across_nodes ? ctx.internode_rank : 0;
+    // part of the node is split further between node processes
+    auto [nlo, nhi] = detail::split_range(count, node, nodes);
+    auto [lo, hi]   = detail::split_range(nhi - nlo, ctx.node_rank, ctx.node_size);
+    int ok          = 1;
+    if (hi > lo) {
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        ok = 0;
+      } else {
+        try {
+          detail::pread_all(fd, reinterpret_cast<char*>(data + nlo + lo), (hi - lo) * sizeof(T),
+                            offset + (nlo + lo) * sizeof(T), filename);
+        } catch (const mpi_io_error&) {
+          ok = 0;
+        }
+        ::close(fd);
+      }
+    }
+    // other processes must not be left waiting in the barrier or in the exchange between nodes
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, nodes > 1 ? MPI_Comm(ctx.global) : MPI_Comm(ctx.node_comm));
+    if (!ok) throw mpi_io_error("Failed to read file " + filename + ".");
+    ctx.barrier().wait();
+    if (nodes > 1 && !ctx.node_rank) {
+      for (int k = 0; k < nodes; ++k) {
+        auto [klo, khi] = detail::split_range(count, k, nodes);
+        broadcast(reinterpret_cast<char*>(data + klo), (khi - klo) * sizeof(T), ctx.internode_comm, k);
+      }
+    }
+    ctx.barrier().wait();
+  }
+
+  /**
+   * Fill shared object from a flat binary file written by `write_distributed`.
+   *
+   * @tparam Shared - type of shared data access object
+   * @param filename - name of the file
+   * @param dest - shared object to fill, its size should match number of elements in the file
+   * @param split_across_nodes - read different parts of the file on different nodes
+   */
+  template <typename Shared>
+  void read_shared(const std::string& filename, shared_object<Shared>& dest, bool split_across_nodes = false) {
+    mpi_context& ctx = dest.ctx();
+    // header is read once and broadcasted to avoid opening the file on every process twice
+    file_header header;
+    int         valid = 1;
+    if (!ctx.global_rank) {
+      try {
+        header = read_file_header(filename);
+      } catch (const mpi_io_error&) {
+        valid = 0;
+      }
+    }
+    MPI_Bcast(&valid, 1, MPI_INT, 0, ctx.global);
+    if (!valid) throw mpi_io_error("Failed to read header of file " + filename + ".");
+    MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, ctx.global);
+    if (header.element_size != sizeof(typename Shared::value_type) || header.count != dest.size())
+      throw mpi_io_error("Content of file " + filename + " mismatches shared object.");
+    read_shared(filename, header.data_offset, dest, split_across_nodes);
+  }
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_IO_H
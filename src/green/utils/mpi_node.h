@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_NODE_H
+#define GREEN_UTILS_MPI_NODE_H
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  namespace detail {
+    /**
+     * Number of elements of type T in a chunk such that `parts` chunks, each padded to a cache line, fit into `bytes`.
+     */
+    template <typename T>
+    size_t chunk_elements(size_t bytes, size_t parts) {
+      size_t line  = std::max<size_t>(cache_line_size / sizeof(T), 1);
+      size_t chunk = (bytes / parts) / sizeof(T);
+      chunk        = (chunk / line) * line;
+      if (chunk == 0) throw mpi_shared_memory_error("Shared workspace is too small for the node-level collective.");
+      return chunk;
+    }
+
+    /**
+     * Range of elements [begin, end) processed by a node rank in a slice-wise operation. Boundaries are aligned to cache
+     * lines so that neighbouring ranks do not write into the same line.
+     */
+    template <typename T>
+    std::pair<size_t, size_t> node_slice(size_t count, int rank, int size) {
+      size_t line  = std::max<size_t>(cache_line_size / sizeof(T), 1);
+      size_t lines = (count + line - 1) / line;
+      size_t begin = std::min(count, (lines * rank / size) * line);
+      size_t end   = std::min(count, (lines * (rank + 1) / size) * line);
+      return {begin, end};
+    }
+  }  // namespace detail
+
+  /**
+   * Broadcast data from `root` to all processes of the node through the node shared workspace. Root copies each chunk
+   * into the workspace once and every other process copies it out. Data that already lives in a `shared_object` does
+   * not need to be broadcasted, it can be read in place after `ctx.barrier().wait()`.
+   *
+   * @tparam T - trivially copyable element type
+   * @param data - pointer to the data
+   * @param count - number of elements
+   * @param root - node rank of the source process
+   * @param ctx - MPI context
+   */
+  template <typename T>
+  void node_broadcast(T* data, size_t count, int root, mpi_context& ctx) {
+    watchdog_guard guard("node_broadcast");
+    static_assert(std::is_trivially_copyable_v<T>, "Node broadcast requires trivially copyable type.");
+    if (ctx.node_size == 1) return;
+    T*     buffer = ctx.workspace().as<T>();
+    size_t chunk  = detail::chunk_elements<T>(ctx.workspace().size(), 1);
+    for (size_t offset = 0; offset < count; offset += chunk) {
+      size_t n = std::min(chunk, count - offset);
+      if (ctx.node_rank == root) std::memcpy(buffer, data + offset, n * sizeof(T));
+      ctx.barrier().wait();
+      if (ctx.node_rank != root) std::memcpy(data + offset, buffer, n * sizeof(T));
+      ctx.barrier().wait();
+    }
+  }
+
+  namespace detail {
+    /**
+     * Reduce contributions of all node processes through the node shared workspace. Every process copies its chunk into
+     * its own segment of the workspace, then each process combines a disjoint slice of the chunk over all segments,
+     * storing result in the first segment.
+     */
+    template <typename T, typename Op>
+    void node_reduce_impl(const T* in, T* out, size_t count, int root, bool all, Op op, mpi_context& ctx) {
+      static_assert(std::is_trivially_copyable_v<T>, "Node reduction requires trivially copyable type.");
+      if (ctx.node_size == 1) {
+        if (in != out) std::copy(in, in + count, out);
+        return;
+      }
+      T*     buffer = ctx.workspace().as<T>();
+      size_t chunk  = chunk_elements<T>(ctx.workspace().size(), ctx.node_size);
+      for (size_t offset = 0; offset < count; offset += chunk) {
+        size_t n = std::min(chunk, count - offset);
+        std::memcpy(buffer + ctx.node_rank * chunk, in + offset, n * sizeof(T));
+        ctx.barrier().wait();
+        auto [begin, end] = node_slice<T>(n, ctx.node_rank, ctx.node_size);
+        for (int r = 1; r < ctx.node_size; ++r) {
+          const T* __restrict src = buffer + r * chunk;
+          T* __restrict       dst = buffer;
+          for (size_t i = begin; i < end; ++i) dst[i] = op(dst[i], src[i]);
+        }
+        ctx.barrier().wait();
+        if (all || ctx.node_rank == root) std::memcpy(out + offset, buffer, n * sizeof(T));
+        ctx.barrier().wait();
+      }
+    }
+  }  // namespace detail
+
+  /**
+   * Reduce data over all processes of the node through the node shared workspace. All node processes take part in the
+   * combination, each of them reduces its own slice of the data.
+   *
+   * @tparam T - trivially copyable element type
+   * @tparam Op - binary element-wise operation
+   * @param in - input data, can be the same as `out`
+   * @param out - output buffer, significant only on the root process
+   * @param count - number of elements
+   * @param root - node rank of the process that receives the result
+   * @param ctx - MPI context
+   * @param op - binary operation, summation by default
+   */
+  template <typename T, typename Op = std::plus<T>>
+  void node_reduce(const T* in, T* out, size_t count, int root, mpi_context& ctx, Op op = Op()) {
+    watchdog_guard guard("node_reduce");
+    detail::node_reduce_impl(in, out, count, root, false, op, ctx);
+  }
+
+  /**
+   * Reduce data over all processes of the node through the node shared workspace, result is available on all processes.
+   *
+   * @tparam T - trivially copyable element type
+   * @tparam Op - binary element-wise operation
+   * @param in - input data, can be the same as `out`
+   * @param out - output buffer
+   * @param count - number of elements
+   * @param ctx - MPI context
+   * @param op - binary operation, summation by default
+   */
+  template <typename T, typename Op = std::plus<T>>
+  void node_allreduce(const T* in, T* out, size_t count, mpi_context& ctx, Op op = Op()) {
+    watchdog_guard guard("node_allreduce");
+    detail::node_reduce_impl(in, out, count, 0, true, op, ctx);
+  }
+
+  /**
+   * Two-level all-reduce: contributions are reduced within the node through the node shared workspace, node leaders
+   * combine node results over the inter-node communicator with the MPI operation generated from the same functor, and
+   * the result is broadcasted within the node through shared memory.
+   *
+   * @tparam T - trivially copyable element type
+   * @tparam Op - binary element-wise operation, should be commutative
+   * @param in - input data, can be the same as `out`
+   * @param out - output buffer
+   * @param count - number of elements
+   * @param ctx - MPI context
+   * @param op - binary operation, summation by default
+   */
+  template <typename T, typename Op = std::plus<T>>
+  void hierarchical_allreduce(const T* in, T* out, size_t count, mpi_context& ctx, Op op = Op()) {
+    watchdog_guard guard("hierarchical_allreduce");
+    detail::node_reduce_impl(in, out, count, 0, false, op, ctx);
+    if (!ctx.node_rank && ctx.internode_size > 1) {
+      MPI_Datatype dt     = record_type<T>();
+      MPI_Op       mpi_op = functor_operation<T>(op);
+      for (size_t offset = 0; offset < count; offset += INT_MAX) {
+        int n = static_cast<int>(std::min<size_t>(INT_MAX, count - offset));
+        if (MPI_Allreduce(MPI_IN_PLACE, out + offset, n, dt, mpi_op, ctx.internode_comm) != MPI_SUCCESS)
+          throw mpi_communication_error("Inter-node reduction failed.");
+      }
+    }
+    node_broadcast(out, count, 0, ctx);
+  }
+
+  /**
+   * All-to-all exchange of equally sized blocks between processes of the node through the node shared workspace.
+   * Every process writes its outgoing blocks into the staging slots of their receivers and, after a node barrier, reads
+   * incoming blocks from its own slots. Slots are padded to cache lines, so processes writing neighbouring blocks do not
+   * share cache lines. Blocks larger than the workspace allows are exchanged in several rounds.
+   *
+   * @tparam T - trivially copyable element type
+   * @param send - `node_size` outgoing blocks, block `j` is sent to node rank `j`
+   * @param recv - `node_size` incoming blocks, block `i` is received from node rank `i`
+   * @param block - number of elements in each block
+   * @param ctx - MPI context
+   */
+  template <typename T>
+  void node_alltoall(const T* send, T* recv, size_t block, mpi_context& ctx) {
+    watchdog_guard guard("node_alltoall");
+    static_assert(std::is_trivially_copyable_v<T>, "Node all-to-all requires trivially copyable type.");
+    int n = ctx.node_size;
+    if (n == 1) {
+      if (send != recv) std::copy(send, send + block, recv);
+      return;
+    }
+    T*     buffer = ctx.workspace().as<T>();
+    size_t chunk  = detail::chunk_elements<T>(ctx.workspace().size(), size_t(n) * n);
+    int    me     = ctx.node_rank;
+    for (size_t offset = 0; offset < block; offset += chunk) {
+      size_t count = std::min(chunk, block - offset);
+      for (int j = 0; j < n; ++j) {
+        std::memcpy(buffer + (size_t(me) * n + j) * chunk, send + j * block + offset, count * sizeof(T));
+      }
+      ctx.barrier().wait();
+      for (int i = 0; i < n; ++i) {
+        std::memcpy(recv + i * block + offset, buffer + (size_t(i) * n + me) * chunk, count * sizeof(T));
+      }
+      ctx.barrier().wait();
+    }
+  }
+
+  /**
+   * Hierarchical exclusive element-wise prefix sum. Node-local part is computed through the node shared workspace and
+   * node leaders perform a single scan over the internode communicator. Processes are ordered node by node and by node
+   * rank within a node, which coincides with the global rank order when ranks are placed on nodes in blocks.
+   *
+   * @tparam T - element type
+   * @param values - values of the current process
+   * @param ctx - MPI context
+   * @param total - optional output for the element-wise sum over all processes
+   * @return sum of values on processes preceding the current one
+   */
+  template <typename T>
+  std::vector<T> node_exscan(const std::vector<T>& values, mpi_context& ctx, std::vector<T>* total = nullptr) {
+    watchdog_guard guard("node_exscan");
+    size_t count = values.size();
+    if (ctx.node_size == 1) {
+      if (ctx.global_size == 1) {
+        if (total) *total = values;
+        return std::vector<T>(count, T(0));
+      }
+      return exscan(values, ctx.internode_comm, total);
+    }
+    int n = ctx.node_size;
+    // slots for values of each node process followed by node offset and total sum
+    if ((n + 2) * count * sizeof(T) > ctx.workspace().size())
+      throw mpi_shared_memory_error("Shared workspace is too small for the node-level scan.");
+    T* slots = ctx.workspace().as<T>();
+    std::copy(values.begin(), values.end(), slots + ctx.node_rank * count);
+    ctx.barrier().wait();
+    std::vector<T> result(count, T(0));
+    std::vector<T> node_total(count, T(0));
+    for (int r = 0; r < n; ++r) {
+      for (size_t i = 0; i < count; ++i) {
+        if (r < ctx.node_rank) result[i] += slots[r * count + i];
+        node_total[i] += slots[r * count + i];
+      }
+    }
+    T* base = slots + n * count;
+    T* sum  = base + count;
+    if (!ctx.node_rank) {
+      std::vector<T> global_total;
+      std::vector<T> node_base = exscan(node_total, ctx.internode_comm, &global_total);
+      std::copy(node_base.begin(), node_base.end(), base);
+      std::copy(global_total.begin(), global_total.end(), sum);
+    }
+    ctx.barrier().wait();
+    for (size_t i = 0; i < count; ++i) result[i] += base[i];
+    if (total) total->assign(sum, sum + count);
+    ctx.barrier().wait();
+    return result;
+  }
+
+  template <typename T>
+  T node_exscan(T value, mpi_context& ctx, T* total = nullptr) {
+    std::vector<T> sum;
+    T              result = node_exscan(std::vector<T>{value}, ctx, total ? &sum : nullptr)[0];
+    if (total) *total = sum[0];
+    return result;
+  }
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_NODE_H
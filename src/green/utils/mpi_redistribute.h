@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_REDISTRIBUTE_H
+#define GREEN_UTILS_MPI_REDISTRIBUTE_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Distribution of a one-dimensional array between processes.
+   *
+   * Every element is owned by exactly one process, elements of a process are stored locally in increasing order of
+   * their global indices. Supported layouts are contiguous blocks, block-cyclic (cyclic for block size 1) and custom
+   * layouts given by the owner of every element.
+   */
+  class layout {
+    enum class kind_t { block, block_cyclic, custom };
+
+  public:
+    /**
+     * Contiguous blocks, process `p` owns elements `[size * p / nprocs, size * (p + 1) / nprocs)`
+     */
+    static layout block(size_t size, int nprocs) { return layout(kind_t::block, size, nprocs, 1); }
+
+    /**
+     * Blocks of `block_size` elements dealt to processes in round-robin order
+     */
+    static layout block_cyclic(size_t size, int nprocs, size_t block_size) {
+      if (block_size == 0) throw mpi_communicator_error("Block size of block-cyclic layout should be positive.");
+      return layout(kind_t::block_cyclic, size, nprocs, block_size);
+    }
+
+    static layout cyclic(size_t size, int nprocs) { return block_cyclic(size, nprocs, 1); }
+
+    /**
+     * @param owners - owner process of every element
+     * @param nprocs - number of processes
+     */
+    static layout custom(std::vector<int> owners, int nprocs) {
+      layout result(kind_t::custom, owners.size(), nprocs, 1);
+      result._local.resize(owners.size());
+      result._counts.assign(nprocs, 0);
+      for (size_t i = 0; i < owners.size(); ++i) {
+        if (owners[i] < 0 || owners[i] >= nprocs) throw mpi_communicator_error("Owner of an element is out of range.");
+        result._local[i] = result._counts[owners[i]]++;
+      }
+      result._owners = std::move(owners);
+      return result;
+    }
+
+    size_t size() const { return _size; }
+    int    nprocs() const { return _nprocs; }
+
+    int owner(size_t i) const {
+      switch (_kind) {
+        case kind_t::block: {
+          int p = static_cast<int>((i * _nprocs) / _size);
+          while (block_begin(p + 1) <= i) ++p;
+          while (block_begin(p) > i) --p;
+          return p;
+        }
+        case kind_t::block_cyclic:
+          return static_cast<int>((i / _block) % _nprocs);
+        default:
+          return _owners[i];
+      }
+    }
+
+    size_t local_index(size_t i) const {
+      switch (_kind) {
+        case kind_t::block:
+          return i - block_begin(owner(i));
+        case kind_t::block_cyclic:
+          return (i / _block / _nprocs) * _block + i % _block;
+        default:
+          return _local[i];
+      }
+    }
+
+    size_t local_size(int p) const {
+      switch (_kind) {
+        case kind_t::block:
+          return block_begin(p + 1) - block_begin(p);
+        case kind_t::block_cyclic: {
+          size_t nblocks = (_size + _block - 1) / _block;
+          size_t size    = 0;
+          for (size_t b = p; b < nblocks; b += _nprocs) size += std::min(_block, _size - b * _block);
+          return size;
+        }
+        default:
+          return _counts[p];
+      }
+    }
+
+    /**
+     * Call `f(global_index, local_index)` for all elements of process `p` in increasing order of global indices
+     */
+    template <typename F>
+    void for_each_local(int p, F&& f) const {
+      switch (_kind) {
+        case kind_t::block:
+          for (size_t i = block_begin(p), l = 0; i < block_begin(p + 1); ++i, ++l) f(i, l);
+          break;
+        case kind_t::block_cyclic: {
+          size_t l = 0;
+          for (size_t b = p * _block; b < _size; b += _nprocs * _block) {
+            for (size_t i = b; i < std::min(b + _block, _size); ++i, ++l) f(i, l);
+          }
+          break;
+        }
+        default:
+          for (size_t i = 0; i < _size; ++i) {
+            if (_owners[i] == p) f(i, _local[i]);
+          }
+      }
+    }
+
+  private:
+    kind_t              _kind;
+    size_t              _size;
+    int                 _nprocs;
+    size_t              _block;
+    std::vector<int>    _owners;
+    std::vector<size_t> _local;
+    std::vector<size_t> _counts;
+
+    layout(kind_t kind, size_t size, int nprocs, size_t block) : _kind(kind), _size(size), _nprocs(nprocs), _block(block) {}
+
+    size_t block_begin(int p) const { return (_size * p) / _nprocs; }
+  };
+
+  /**
+   * @brief Communication plan that moves an array from one layout to another.
+   *
+   * The plan is computed once from the two layouts and can be executed for any number of arrays of any element type.
+   * Elements that stay on the same process are copied directly, the rest are packed into contiguous runs per
+   * destination, exchanged with a single all-to-all and unpacked. Runs of consecutive elements are copied with memcpy.
+   */
+  class redistribution {
+    // run of `count` consecutive elements: offset in the source local array and offset in the destination local array
+    struct run_t {
+      size_t src;
+      size_t dst;
+      size_t count;
+    };
+
+  public:
+    /**
+     * Build plan. Not collective, every process computes its own part of the plan.
+     *
+     * @param src - source layout
+     * @param dst - destination layout
+     * @param comm - MPI communicator, its size should match number of processes in both layouts
+     */
+    redistribution(const layout& src, const layout& dst, MPI_Comm comm) : _comm(comm) {
+      int size;
+      MPI_Comm_rank(comm, &_rank);
+      MPI_Comm_size(comm, &size);
+      if (src.nprocs() != size || dst.nprocs() != size || src.size() != dst.size())
+        throw mpi_communicator_error("Layouts do not match each other or the communicator.");
+      _src_size = src.local_size(_rank);
+      _dst_size = dst.local_size(_rank);
+      std::vector<std::vector<run_t>> send(size), recv(size);
+      _send_counts.assign(size, 0);
+      _recv_counts.assign(size, 0);
+      // elements are exchanged between each pair of processes in increasing order of global indices, position in the
+      // message plays the role of the offset on the other side
+      src.for_each_local(_rank, [&](size_t i, size_t l) {
+        int q = dst.owner(i);
+        if (q == _rank)
+          append(_self, l, dst.local_index(i));
+        else
+          append(send[q], l, _send_counts[q]++);
+      });
+      dst.for_each_local(_rank, [&](size_t i, size_t l) {
+        int p = src.owner(i);
+        if (p != _rank) append(recv[p], _recv_counts[p]++, l);
+      });
+      _send_index.assign(size + 1, 0);
+      _recv_index.assign(size + 1, 0);
+      for (int p = 0; p < size; ++p) {
+        _send_runs.insert(_send_runs.end(), send[p].begin(), send[p].end());
+        _recv_runs.insert(_recv_runs.end(), recv[p].begin(), recv[p].end());
+        _send_index[p + 1] = _send_runs.size();
+        _recv_index[p + 1] = _recv_runs.size();
+      }
+      _send_total = std::accumulate(_send_counts.begin(), _send_counts.end(), size_t(0));
+      _recv_total = std::accumulate(_recv_counts.begin(), _recv_counts.end(), size_t(0));
+    }
+
+    /**
+     * Move data from source to destination layout. Collective over the communicator.
+     *
+     * When send and receive buffers do not fit into `max_bytes`, data is exchanged in several rounds, each round moves
+     * at most a fixed number of elements between every pair of processes. Rounds are sized against the size classes of
+     * the buffer pool, so that the memory actually allocated stays within `max_bytes` (but is at least two buffers of
+     * the smallest class). Budgets may differ between processes: all processes agree on the smallest slice size and on
+     * the largest number of rounds, so messages are cut at the same offsets on both sides. Number of extra rounds and
+     * allocated temporary bytes are recorded as counters of the global timing object.
+     *
+     * @tparam T - trivially copyable element type
+     * @param in - local part of the array in the source layout
+     * @param out - local part of the array in the destination layout
+     * @param max_bytes - limit for temporary buffers of the process
+     */
+    template <typename T>
+    void execute(const T* in, T* out, size_t max_bytes = std::numeric_limits<size_t>::max()) const {
+      static_assert(std::is_trivially_copyable_v<T>, "Redistribution requires trivially copyable type.");
+      watchdog_guard guard("redistribution");
+      int            size     = _send_counts.size();
+      size_t         per_peer = std::numeric_limits<size_t>::max();
+      size_t         rounds   = 1;
+      if (max_bytes != std::numeric_limits<size_t>::max() &&
+          buffer_pool::allocated_bytes(_send_total * sizeof(T)) + buffer_pool::allocated_bytes(_recv_total * sizeof(T)) >
+              std::max(max_bytes, 2 * buffer_pool::min_class_size)) {
+        // each of the two buffers gets the largest pool size class that fits into half of the budget
+        size_t buffer_bytes = buffer_pool::min_class_size;
+        while (buffer_bytes * 2 <= max_bytes / 2) buffer_bytes *= 2;
+        per_peer = std::max<size_t>(buffer_bytes / (sizeof(T) * size), 1);
+      }
+      size_t longest = 0;
+      for (int p = 0; p < size; ++p) longest = std::max({longest, _send_counts[p], _recv_counts[p]});
+      // smallest slice and, through the complement, longest message over all processes in a single reduction
+      size_t agreed[2] = {per_peer, std::numeric_limits<size_t>::max() - longest};
+      MPI_Allreduce(MPI_IN_PLACE, agreed, 2, mpi_type<size_t>::type, MPI_MIN, _comm);
+      per_peer = agreed[0];
+      longest  = std::numeric_limits<size_t>::max() - agreed[1];
+      if (per_peer != std::numeric_limits<size_t>::max()) rounds = std::max<size_t>((longest + per_peer - 1) / per_peer, 1);
+      if (rounds == 1) per_peer = std::numeric_limits<size_t>::max();
+      std::vector<size_t> send_counts(size), recv_counts(size);
+      size_t              send_max = 0, recv_max = 0;
+      for (int p = 0; p < size; ++p) {
+        send_max += std::min(_send_counts[p], per_peer);
+        recv_max += std::min(_recv_counts[p], per_peer);
+      }
+      pooled_buffer<T> send_buffer(send_max);
+      pooled_buffer<T> recv_buffer(recv_max);
+      if (max_bytes != std::numeric_limits<size_t>::max()) {
+        timing& statistic = timing::get_instance();
+        statistic.counter("memory budget extra rounds") += rounds - 1;
+        double& peak  = statistic.counter("memory budget peak temporary bytes");
+        size_t  bytes = buffer_pool::allocated_bytes(send_max * sizeof(T)) + buffer_pool::allocated_bytes(recv_max * sizeof(T));
+        peak          = std::max(peak, double(bytes));
+      }
+      for (auto& r : _self) copy_run(in + r.src, out + r.dst, r.count);
+      for (size_t round = 0; round < rounds; ++round) {
+        size_t lo     = round * per_peer;
+        size_t hi     = rounds == 1 ? std::numeric_limits<size_t>::max() : lo + per_peer;
+        T*     packed = send_buffer.data();
+        for (int p = 0; p < size; ++p) {
+          send_counts[p] = std::min(_send_counts[p], hi) - std::min(_send_counts[p], lo);
+          recv_counts[p] = std::min(_recv_counts[p], hi) - std::min(_recv_counts[p], lo);
+          // position in the message is stored as destination offset of send runs
+          for_each_overlap<&run_t::dst>(_send_runs, _send_index[p], _send_index[p + 1], lo, hi,
+                                        [&](const run_t& r, size_t begin, size_t end) {
+                                          packed = copy_run(in + r.src + (begin - r.dst), packed, end - begin);
+                                        });
+        }
+        alltoallv(send_buffer.data(), send_counts, recv_buffer.data(), recv_counts, record_type<T>(), _comm);
+        const T* unpacked = recv_buffer.data();
+        for (int p = 0; p < size; ++p) {
+          // position in the message is stored as source offset of receive runs
+          for_each_overlap<&run_t::src>(_recv_runs, _recv_index[p], _recv_index[p + 1], lo, hi,
+                                        [&](const run_t& r, size_t begin, size_t end) {
+                                          copy_run(unpacked, out + r.dst + (begin - r.src), end - begin);
+                                          unpacked += end - begin;
+                                        });
+        }
+      }
+    }
+
+    /**
+     * Move data from source to destination layout using temporary buffers within the per-process share of the node
+     * memory budget of the context. Collective over the communicator.
+     */
+    template <typename T>
+    void execute(const T* in, T* out, const mpi_context& ctx) const {
+      execute(in, out, ctx.temporary_budget());
+    }
+
+    size_t source_size() const { return _src_size; }
+    size_t destination_size() const { return _dst_size; }
+    // number of elements sent to other processes
+    size_t send_volume() const { return _send_total; }
+    // number of runs copied in pack, self copy and unpack
+    size_t runs() const { return _send_runs.size() + _self.size() + _recv_runs.size(); }
+
+  private:
+    MPI_Comm            _comm;
+    int                 _rank;
+    size_t              _src_size;
+    size_t              _dst_size;
+    std::vector<run_t>  _self;
+    std::vector<run_t>  _send_runs;
+    std::vector<run_t>  _recv_runs;
+    // runs exchanged with process p are stored in [index[p], index[p + 1])
+    std::vector<size_t> _send_index;
+    std::vector<size_t> _recv_index;
+    std::vector<size_t> _send_counts;
+    std::vector<size_t> _recv_counts;
+    size_t              _send_total;
+    size_t              _recv_total;
+
+    // extend last run if both offsets continue it, start a new run otherwise
+    static void append(std::vector<run_t>& runs, size_t src, size_t dst) {
+      if (!runs.empty()) {
+        run_t& last = runs.back();
+        if (last.src + last.count == src && last.dst + last.count == dst) {
+          ++last.count;
+          return;
+        }
+      }
+      runs.push_back({src, dst, 1});
+    }
+
+    /**
+     * Call `f(run, begin, end)` for runs of [first, last) that overlap with message positions [lo, hi), `begin` and `end`
+     * bound the overlapping part. `Pos` selects the field that stores positions in the message.
+     */
+    template <size_t run_t::*Pos, typename F>
+    static void for_each_overlap(const std::vector<run_t>& runs, size_t first, size_t last, size_t lo, size_t hi, F&& f) {
+      auto it = std::partition_point(runs.begin() + first, runs.begin() + last,
+                                     [lo](const run_t& r) { return r.*Pos + r.count <= lo; });
+      for (; it != runs.begin() + last && (*it).*Pos < hi; ++it) {
+        f(*it, std::max(lo, (*it).*Pos), std::min(hi, (*it).*Pos + it->count));
+      }
+    }
+
+    template <typename T>
+    static T* copy_run(const T* from, T* to, size_t count) {
+      if (count == 1)
+        *to = *from;
+      else
+        std::memcpy(to, from, count * sizeof(T));
+      return to + count;
+    }
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_REDISTRIBUTE_H
@@ -23,10 +23,22 @@
 #define GREEN_UTILS_MPI_SHARED_H
 
 #include <array>
+#include <climits>
+#include <cstring>
+#include <vector>
 
 #include "mpi_utils.h"
 
 namespace green::utils {
+  /**
+   * @brief Data access object backed by MPI shared memory of a node.
+   *
+   * Memory is allocated on the node communicator of an `mpi_context`, by default the global context built on
+   * MPI_COMM_WORLD. Passing a context built on a sub-communicator places the object on the node split of that
+   * sub-communicator.
+   *
+   * @tparam Shared - type of data access object
+   */
   template <typename Shared>
   class shared_object {
   private:
@@ -35,34 +47,47 @@ namespace green::utils {
     typename Shared::value_type* _ref;
     size_t                       _local_size{};
     MPI_Win                      _win{};
+    mpi_context*                 _ctx;
 
     void                         assign_ptr() {
-      _local_size = _size / mpi_context::context().node_size;
-      _local_size += ((_size % mpi_context::context().node_size) > mpi_context::context().node_rank) ? 1 : 0;
+      _local_size = _size / _ctx->node_size;
+      _local_size += ((_size % _ctx->node_size) > _ctx->node_rank) ? 1 : 0;
       MPI_Aint l_size = _local_size;
       MPI_Aint g_size = _local_size;
-      setup_mpi_shared_memory(&_ref, _local_size, g_size, _win, mpi_context::context());
+      setup_mpi_shared_memory(&_ref, _local_size, g_size, _win, *_ctx);
       _object.set_ref(_ref);
     }
 
   public:
     template <typename... Args>
-    explicit shared_object(size_t s1, Args... args) : _object(nullptr, s1, size_t(args)...), _size(_object.size()) {
+    explicit shared_object(size_t s1, Args... args) : shared_object(mpi_context::context(), s1, args...) {}
+
+    template <size_t N>
+    explicit shared_object(const std::array<size_t, N>& shape) : shared_object(mpi_context::context(), shape) {}
+
+    shared_object(Shared& obj) : shared_object(mpi_context::context(), obj) {}
+
+    shared_object(Shared&& obj) : shared_object(mpi_context::context(), std::move(obj)) {}
+
+    template <typename... Args>
+    shared_object(mpi_context& ctx, size_t s1, Args... args) :
+        _object(nullptr, s1, size_t(args)...), _size(_object.size()), _ctx(&ctx) {
       assign_ptr();
     }
 
     template <size_t N>
-    explicit shared_object(const std::array<size_t, N>& shape) : _object(nullptr, shape), _size(_object.size()) {
+    shared_object(mpi_context& ctx, const std::array<size_t, N>& shape) :
+        _object(nullptr, shape), _size(_object.size()), _ctx(&ctx) {
       assign_ptr();
     }
 
-    shared_object(Shared& obj) : _object(obj), _size(obj.size()) { assign_ptr(); }
+    shared_object(mpi_context& ctx, Shared& obj) : _object(obj), _size(obj.size()), _ctx(&ctx) { assign_ptr(); }
 
-    shared_object(Shared&& obj) : _object(obj), _size(obj.size()) { assign_ptr(); }
+    shared_object(mpi_context& ctx, Shared&& obj) : _object(obj), _size(obj.size()), _ctx(&ctx) { assign_ptr(); }
 
     shared_object(const shared_object& rhs) = delete;
     shared_object(shared_object&& rhs) :
-        _object(rhs._object), _size(rhs._size), _ref(rhs._ref), _local_size(rhs._local_size), _win(rhs._win) {
+        _object(rhs._object), _size(rhs._size), _ref(rhs._ref), _local_size(rhs._local_size), _win(rhs._win), _ctx(rhs._ctx) {
       rhs._win = MPI_WIN_NULL;
       rhs._ref = nullptr;
     }
@@ -73,6 +98,7 @@ namespace green::utils {
       _ref        = rhs._ref;
       _local_size = rhs._local_size;
       _win        = rhs._win;
+      _ctx        = rhs._ctx;
       rhs._win    = MPI_WIN_NULL;
       rhs._ref    = nullptr;
       return *this;
@@ -83,6 +109,11 @@ namespace green::utils {
     }
 
     void          fence(int assert = 0) { MPI_Win_fence(assert, _win); }
+    /**
+     * Synchronize direct load/store access to the shared memory by processes of the node through the shared memory
+     * barrier of the context. Unlike `fence`, it does not open or close RMA epochs.
+     */
+    void          sync() { _ctx->barrier().wait(); }
 
     size_t        local_size() const { return _local_size; }
     MPI_Win       win() const { return _win; }
@@ -90,8 +121,65 @@ namespace green::utils {
     size_t        size() const { return _size; }
     const Shared& object() const { return _object; }
     Shared&       object() { return _object; }
+    // context the shared memory is allocated in
+    mpi_context&  ctx() const { return *_ctx; }
   };
 
+  /**
+   * Gather pieces of a distributed array into a shared object, so that every node ends up with exactly one copy of the
+   * full array. Each process writes its piece directly into the node shared buffer, then node leaders exchange pieces
+   * written on other nodes over the internode communicator. Pieces are placed in the order of global ranks. Collective
+   * over the global communicator of the context of the shared object.
+   *
+   * @tparam Shared - type of shared data access object
+   * @param local - local piece of the array
+   * @param count - number of elements in the local piece
+   * @param dest - shared object that receives full array, its size should be equal to the total number of elements
+   */
+  template <typename Shared>
+  void allgather(const typename Shared::value_type* local, size_t count, shared_object<Shared>& dest) {
+    watchdog_guard guard("allgather");
+    using T     = typename Shared::value_type;
+    auto& ctx   = dest.ctx();
+    T*    data  = dest.object().data();
+    if (ctx.global_size == 1) {
+      if (count != dest.size()) throw mpi_communication_error("Size of shared object mismatches gathered data.");
+      std::memcpy(data, local, count * sizeof(T));
+      return;
+    }
+    // (number of elements, node index) for every process
+    std::array<unsigned long, 2> info{count, static_cast<unsigned long>(ctx.internode_rank)};
+    std::vector<unsigned long>   infos(2 * ctx.global_size);
+    MPI_Allgather(info.data(), 2, MPI_UNSIGNED_LONG, infos.data(), 2, MPI_UNSIGNED_LONG, ctx.global);
+    std::vector<size_t> offsets(ctx.global_size + 1, 0);
+    for (int r = 0; r < ctx.global_size; ++r) offsets[r + 1] = offsets[r] + infos[2 * r];
+    if (offsets[ctx.global_size] != dest.size()) throw mpi_communication_error("Size of shared object mismatches gathered data.");
+    std::memcpy(data + offsets[ctx.global_rank], local, count * sizeof(T));
+    ctx.barrier().wait();
+    if (!ctx.node_rank && ctx.internode_size > 1) {
+      for (int node = 0; node < ctx.internode_size; ++node) {
+        // pieces of all processes of the node, split to keep block lengths in the int range
+        std::vector<int>      lengths;
+        std::vector<MPI_Aint> displacements;
+        for (int r = 0; r < ctx.global_size; ++r) {
+          if (infos[2 * r + 1] != static_cast<unsigned long>(node)) continue;
+          for (size_t offset = offsets[r]; offset < offsets[r + 1]; offset += INT_MAX) {
+            lengths.push_back(static_cast<int>(std::min<size_t>(INT_MAX, offsets[r + 1] - offset)));
+            displacements.push_back(offset * sizeof(T));
+          }
+        }
+        if (lengths.empty()) continue;
+        MPI_Datatype node_type;
+        MPI_Type_create_hindexed(lengths.size(), lengths.data(), displacements.data(), mpi_type<T>::type, &node_type);
+        MPI_Type_commit(&node_type);
+        if (MPI_Bcast(data, 1, node_type, node, ctx.internode_comm) != MPI_SUCCESS)
+          throw mpi_communication_error("Failed to exchange pieces between nodes.");
+        MPI_Type_free(&node_type);
+      }
+    }
+    ctx.barrier().wait();
+  }
+
 #define context mpi_context::context()
 }  // namespace green::utils
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_SORT_H
+#define GREEN_UTILS_MPI_SORT_H
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  namespace detail {
+    /**
+     * Merge consecutive sorted runs [bounds[i], bounds[i+1]) into one sorted range, merging pairs of runs level by level.
+     */
+    template <typename It, typename Compare>
+    void merge_runs(It begin, std::vector<size_t> bounds, Compare comp) {
+      while (bounds.size() > 2) {
+        std::vector<size_t> merged{bounds[0]};
+        for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+          std::inplace_merge(begin + bounds[i], begin + bounds[i + 1], begin + bounds[i + 2], comp);
+          merged.push_back(bounds[i + 2]);
+        }
+        if (bounds.size() % 2 == 0) merged.push_back(bounds.back());
+        bounds = std::move(merged);
+      }
+    }
+
+    /**
+     * Sort range using `threads` threads: each thread sorts its own part and sorted parts are merged afterwards.
+     */
+    template <typename It, typename Compare>
+    void parallel_sort(It begin, It end, Compare comp, int threads) {
+      size_t n = std::distance(begin, end);
+      threads  = std::max(1, std::min<int>(threads, n / 1024 + 1));
+      if (threads == 1) {
+        std::sort(begin, end, comp);
+        return;
+      }
+      std::vector<size_t> bounds(threads + 1);
+      for (int t = 0; t <= threads; ++t) bounds[t] = n * t / threads;
+      std::vector<std::thread> workers;
+      for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          thread_binding::get_instance().pin_worker(t);
+          std::sort(begin + bounds[t], begin + bounds[t + 1], comp);
+        });
+      }
+      for (auto& w : workers) w.join();
+      merge_runs(begin, bounds, comp);
+    }
+  }  // namespace detail
+
+  /**
+   * Distributed sample sort. After the call records are globally sorted: records on a process are sorted and precede
+   * records of processes with higher rank. Every process sorts its records locally and picks `size` regularly spaced
+   * samples, samples are gathered on the root that selects `size - 1` splitters. Records are then exchanged with a single
+   * large-count all-to-all and received sorted runs are merged.
+   *
+   * @tparam T - trivially copyable record type, exchanged through `record_type<T>()`
+   * @tparam Compare - strict weak ordering of records
+   * @param data - local records, replaced by the local part of the sorted sequence
+   * @param comm - MPI communicator
+   * @param comp - comparison function
+   * @param threads - number of threads used for the local sort
+   */
+  template <typename T, typename Compare = std::less<T>>
+  void sample_sort(std::vector<T>& data, MPI_Comm comm, Compare comp = Compare(), int threads = 1) {
+    watchdog_guard guard("sample_sort");
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    detail::parallel_sort(data.begin(), data.end(), comp, threads);
+    if (size == 1) return;
+    MPI_Datatype dt = record_type<T>();
+
+    // regular samples of the local data
+    int            nsamples = static_cast<int>(std::min<size_t>(size, data.size()));
+    std::vector<T> samples(nsamples);
+    for (int i = 0; i < nsamples; ++i) samples[i] = data[(data.size() * i) / nsamples];
+    std::vector<int> sample_counts(size), sample_displs(size, 0);
+    MPI_Gather(&nsamples, 1, MPI_INT, sample_counts.data(), 1, MPI_INT, 0, comm);
+    std::vector<T> all_samples;
+    if (!rank) {
+      for (int p = 1; p < size; ++p) sample_displs[p] = sample_displs[p - 1] + sample_counts[p - 1];
+      all_samples.resize(sample_displs[size - 1] + sample_counts[size - 1]);
+    }
+    MPI_Gatherv(samples.data(), nsamples, dt, all_samples.data(), sample_counts.data(), sample_displs.data(), dt, 0, comm);
+
+    // splitters are regularly spaced elements of sorted samples
+    int            nsplitters = 0;
+    std::vector<T> splitters(size - 1);
+    if (!rank && !all_samples.empty()) {
+      std::sort(all_samples.begin(), all_samples.end(), comp);
+      nsplitters = size - 1;
+      for (int p = 1; p < size; ++p) splitters[p - 1] = all_samples[(all_samples.size() * p) / size];
+    }
+    MPI_Bcast(&nsplitters, 1, MPI_INT, 0, comm);
+    if (nsplitters == 0) return;
+    MPI_Bcast(splitters.data(), nsplitters, dt, 0, comm);
+
+    // records equal to a splitter go to the higher rank
+    std::vector<size_t> send_counts(size), recv_counts(size);
+    size_t              begin = 0;
+    for (int p = 0; p < size; ++p) {
+      size_t end = p + 1 < size ? std::lower_bound(data.begin() + begin, data.end(), splitters[p], comp) - data.begin()
+                                : data.size();
+      send_counts[p] = end - begin;
+      begin          = end;
+    }
+    MPI_Alltoall(send_counts.data(), 1, mpi_type<size_t>::type, recv_counts.data(), 1, mpi_type<size_t>::type, comm);
+    std::vector<size_t> bounds(size + 1, 0);
+    for (int p = 0; p < size; ++p) bounds[p + 1] = bounds[p] + recv_counts[p];
+    std::vector<T> received(bounds[size]);
+    alltoallv(data.data(), send_counts, received.data(), recv_counts, dt, comm);
+    detail::merge_runs(received.begin(), bounds, comp);
+    data = std::move(received);
+  }
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_SORT_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_STREAM_H
+#define GREEN_UTILS_MPI_STREAM_H
+
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "mpi_utils.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Streaming summation of a distributed array towards the root process.
+   *
+   * Processes push blocks of the array tagged by their global offset as soon as they are computed. Contributions are
+   * accumulated in fixed-size chunks; once a chunk leaves the window of active chunks it is reduced to the root with a
+   * non-blocking reduction and the root passes the reduced chunk to the `consume` callback. Chunks are reduced and
+   * consumed in increasing order, at most `window` chunks are being accumulated and at most `window` chunks are in flight,
+   * so memory footprint does not depend on the size of the array. Chunk buffers are borrowed from the global buffer pool.
+   *
+   * `push` and `finalize` are collective over the communicator: once `window` reductions are in flight, `push` waits for
+   * the oldest one, which needs every process to have started it. Processes therefore have to keep pushing (or call
+   * `finalize`) and must not wait for each other in other blocking communication while a process that runs ahead is
+   * pushing.
+   *
+   * Blocks should be pushed in (roughly) increasing order of offsets: pushing into a chunk that has already been reduced
+   * is an error.
+   *
+   * @tparam T - element type
+   */
+  template <typename T>
+  class stream_reducer {
+  public:
+    using callback_t = std::function<void(size_t offset, const T* data, size_t count)>;
+
+    /**
+     * @param total - total number of elements in the array
+     * @param chunk - number of elements reduced at once
+     * @param comm - MPI communicator
+     * @param root - rank that receives reduced chunks
+     * @param consume - callback that is called on the root for each reduced chunk in increasing order of offsets
+     * @param window - number of chunks that are accumulated and reduced simultaneously
+     */
+    stream_reducer(size_t total, size_t chunk, MPI_Comm comm, int root, callback_t consume, size_t window = 4) :
+        _total(total), _chunk(chunk), _comm(comm), _root(root), _consume(std::move(consume)),
+        _window(std::max<size_t>(window, 1)) {
+      if (_chunk == 0 || _chunk > INT_MAX) throw mpi_communication_error("Chunk size of streaming reduction is out of range.");
+      MPI_Comm_rank(_comm, &_rank);
+      _nchunks = (_total + _chunk - 1) / _chunk;
+    }
+
+    stream_reducer(const stream_reducer&)            = delete;
+    stream_reducer& operator=(const stream_reducer&) = delete;
+
+    /**
+     * Add block of data to the array and progress reductions. Collective: may wait for the oldest reduction in flight to
+     * be started by the other processes.
+     *
+     * @param offset - global offset of the block
+     * @param data - block data
+     * @param count - number of elements in the block
+     */
+    void push(size_t offset, const T* data, size_t count) {
+      if (offset + count > _total) throw mpi_communication_error("Block is out of range of streaming reduction.");
+      while (count > 0) {
+        size_t idx = offset / _chunk;
+        if (idx < _next) throw mpi_communication_error("Block contributes to a chunk that has already been reduced.");
+        while (idx >= _next + _window) flush_next();
+        pooled_buffer<T>& buffer = chunk_buffer(idx);
+        size_t            begin  = offset - idx * _chunk;
+        size_t            n      = std::min(count, buffer.size() - begin);
+        T*                dst    = buffer.data() + begin;
+        for (size_t i = 0; i < n; ++i) dst[i] += data[i];
+        offset += n;
+        data += n;
+        count -= n;
+      }
+      progress();
+    }
+
+    /**
+     * Reduce all remaining chunks and wait for completion. Collective over the communicator.
+     */
+    void finalize() {
+      watchdog_guard guard("stream_reducer::finalize");
+      while (_next < _nchunks) flush_next();
+      while (!_pending.empty()) complete_oldest();
+    }
+
+    /**
+     * @return number of chunks that are accumulated or in flight
+     */
+    size_t buffered_chunks() const { return _active.size() + _pending.size(); }
+
+  private:
+    struct pending_t {
+      size_t           idx;
+      pooled_buffer<T> buffer;
+      MPI_Request      request;
+    };
+
+    size_t                             _total;
+    size_t                             _chunk;
+    MPI_Comm                           _comm;
+    int                                _root;
+    callback_t                         _consume;
+    size_t                             _window;
+    int                                _rank;
+    size_t                             _nchunks;
+    // index of the next chunk to be reduced
+    size_t                             _next = 0;
+    std::map<size_t, pooled_buffer<T>> _active;
+    std::deque<pending_t>              _pending;
+
+    pooled_buffer<T>& chunk_buffer(size_t idx) {
+      auto it = _active.find(idx);
+      if (it == _active.end()) {
+        it = _active.emplace(idx, pooled_buffer<T>(std::min(_chunk, _total - idx * _chunk))).first;
+        std::fill_n(it->second.data(), it->second.size(), T(0));
+      }
+      return it->second;
+    }
+
+    void flush_next() {
+      pending_t p{_next, std::move(chunk_buffer(_next)), MPI_REQUEST_NULL};
+      _active.erase(_next);
+      ++_next;
+      int count = static_cast<int>(p.buffer.size());
+      _pending.push_back(std::move(p));
+      auto& last = _pending.back();
+      int   status;
+      if (_rank == _root) {
+        status = MPI_Ireduce(MPI_IN_PLACE, last.buffer.data(), count, mpi_type<T>::type, MPI_SUM, _root, _comm, &last.request);
+      } else {
+        status = MPI_Ireduce(last.buffer.data(), nullptr, count, mpi_type<T>::type, MPI_SUM, _root, _comm, &last.request);
+      }
+      if (status != MPI_SUCCESS) throw mpi_communication_error("Streaming reduction failed.");
+      if (_pending.size() > _window) complete_oldest();
+    }
+
+    void complete_oldest() {
+      auto& p = _pending.front();
+      MPI_Wait(&p.request, MPI_STATUS_IGNORE);
+      if (_rank == _root) _consume(p.idx * _chunk, p.buffer.data(), p.buffer.size());
+      _pending.pop_front();
+    }
+
+    // deliver chunks whose reduction has already completed
+    void progress() {
+      while (!_pending.empty()) {
+        int done;
+        MPI_Test(&_pending.front().request, &done, MPI_STATUS_IGNORE);
+        if (!done) break;
+        auto& p = _pending.front();
+        if (_rank == _root) _consume(p.idx * _chunk, p.buffer.data(), p.buffer.size());
+        _pending.pop_front();
+      }
+    }
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_STREAM_H
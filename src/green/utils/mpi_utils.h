@@ -8,11 +8,25 @@
 
 #include <mpi.h>
 
+#include <algorithm>
+#include <climits>
 #include <complex>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <vector>
 
+#include "affinity.h"
 #include "except.h"
+#include "mpi_barrier.h"
+#include "mpi_workspace.h"
+#include "watchdog.h"
 
 namespace green::utils {
 
@@ -41,6 +55,8 @@ namespace green::utils {
   template <>
   inline MPI_Datatype mpi_type<float>::type = MPI_FLOAT;
   template <>
+  inline MPI_Datatype mpi_type<char>::type = MPI_CHAR;
+  template <>
   inline MPI_Datatype mpi_type<long>::type = MPI_LONG;
   template <>
   inline MPI_Datatype mpi_type<int>::type = MPI_INT;
@@ -64,11 +80,188 @@ namespace green::utils {
                            int& intranode_size, MPI_Comm& internode_comm, int& internode_rank, int& internode_size);
 
   /**
-   * MPI runtime context
+   * Placement of a process: hash of the host name and NUMA node of the core the process runs on.
+   */
+  struct process_location {
+    std::uint64_t host;
+    int           numa;
+  };
+
+  /**
+   * Gather placement of every process of the communicator with a single MPI_Allgather. Collective over `comm`.
+   *
+   * @param comm - MPI communicator
+   * @return locations of all processes of `comm` in rank order
+   */
+  std::vector<process_location> gather_locations(MPI_Comm comm);
+
+  /**
+   * Create a communicator from a subset of processes of `comm`. Collective only over the processes listed in `ranks`.
+   *
+   * @param comm - parent communicator
+   * @param ranks - ranks of `comm` forming the new communicator, in the order of their new ranks
+   * @param tag - tag distinguishing concurrent group creations on `comm`
+   * @return new communicator
+   */
+  MPI_Comm create_group_communicator(MPI_Comm comm, const std::vector<int>& ranks, int tag);
+
+  /**
+   * Communicator that is created on first use and cached afterwards. Converts implicitly to `MPI_Comm` and `MPI_Comm&`,
+   * and `&` yields `MPI_Comm*`, so it can be used wherever a plain `MPI_Comm` member was used before. The conversion
+   * that creates the communicator is collective over its future members.
+   */
+  class lazy_communicator {
+  public:
+    lazy_communicator() = default;
+    explicit lazy_communicator(std::function<MPI_Comm()> create) : _create(std::move(create)) {}
+
+    lazy_communicator(const lazy_communicator&)            = delete;
+    lazy_communicator& operator=(const lazy_communicator&) = delete;
+    lazy_communicator& operator=(lazy_communicator&&)      = default;
+
+    operator MPI_Comm() const { return get(); }
+    operator MPI_Comm&() { return get(); }
+    MPI_Comm* operator&() { return &get(); }
+
+    /**
+     * @return true if the communicator has already been created
+     */
+    bool created() const { return _created; }
+
+    /**
+     * Free the communicator if it has been created. It will be created again on next use.
+     */
+    void free() {
+      if (_comm != MPI_COMM_NULL) MPI_Comm_free(&_comm);
+      _comm    = MPI_COMM_NULL;
+      _created = false;
+    }
+
+  private:
+    mutable MPI_Comm          _comm    = MPI_COMM_NULL;
+    mutable bool              _created = false;
+    std::function<MPI_Comm()> _create;
+
+    MPI_Comm& get() const {
+      if (!_created) {
+        _comm    = _create ? _create() : MPI_COMM_NULL;
+        _created = true;
+      }
+      return _comm;
+    }
+  };
+
+  /**
+   * Placement of equal process groups: `node_aligned` fills nodes with consecutive groups so that group communication
+   * stays within a node, `interleaved` deals processes of every node round-robin between groups so that each group
+   * spans all nodes.
+   */
+  enum class group_placement { node_aligned, interleaved };
+
+  /**
+   * Split of processes into equal groups, e.g. for independent tasks, with communicators within each group and across
+   * the groups between processes holding the same position in their group. Owns both communicators.
+   */
+  struct process_groups {
+    process_groups() = default;
+    process_groups(process_groups&& rhs) noexcept { *this = std::move(rhs); }
+    process_groups& operator=(process_groups&& rhs) noexcept {
+      std::swap(group_comm, rhs.group_comm);
+      std::swap(cross_comm, rhs.cross_comm);
+      groups      = rhs.groups;
+      group_index = rhs.group_index;
+      group_rank  = rhs.group_rank;
+      group_size  = rhs.group_size;
+      return *this;
+    }
+    process_groups(const process_groups&)            = delete;
+    process_groups& operator=(const process_groups&) = delete;
+
+    ~process_groups() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (finalized) return;
+      if (group_comm != MPI_COMM_NULL) MPI_Comm_free(&group_comm);
+      if (cross_comm != MPI_COMM_NULL) MPI_Comm_free(&cross_comm);
+    }
+
+    // number of groups and index of the group of the current process
+    int      groups      = 1;
+    int      group_index = 0;
+    // processes of the group, ranked by position in the group
+    MPI_Comm group_comm  = MPI_COMM_NULL;
+    int      group_rank  = 0;
+    int      group_size  = 1;
+    // processes with the same `group_rank` in all groups, ranked by `group_index`
+    MPI_Comm cross_comm  = MPI_COMM_NULL;
+  };
+
+  /**
+   * Result of the CPU binding check, flags describe the whole job.
+   */
+  struct binding_report {
+    // some process of a node with several processes may run on every core
+    bool             unpinned       = false;
+    // core sets of processes of the same node overlap
+    bool             overlap        = false;
+    // a node runs more processes than cores available to them
+    bool             oversubscribed = false;
+    // processes have been moved into disjoint core sets
+    bool             repinned       = false;
+    // cores of the current process after the check
+    std::vector<int> cpus;
+  };
+
+  /**
+   * Compute node index for every process of the communicator. Nodes are enumerated in order of their lowest rank.
+   *
+   * @param comm - MPI communicator
+   * @return vector of node indices, one per process of `comm`
+   */
+  std::vector<int> node_ids(MPI_Comm comm);
+
+  /**
+   * Greedy mapping of logical ranks onto nodes. Nodes are filled one after another: each node is seeded with the
+   * heaviest communicating unassigned rank and then grows by the rank with the largest communication volume to the ranks
+   * already placed on that node.
+   *
+   * @param weights - dense row-major `n x n` matrix of communication weights between logical ranks
+   * @param node_sizes - number of processes available on each node, should sum up to `n`
+   * @return node index for every logical rank
+   */
+  std::vector<int> map_ranks_to_nodes(const std::vector<double>& weights, const std::vector<int>& node_sizes);
+
+  /**
+   * Total communication weight between logical ranks that are placed on different nodes.
+   *
+   * @param weights - dense row-major `n x n` matrix of communication weights between logical ranks
+   * @param rank_node - node index for every logical rank
+   * @return internode communication volume
+   */
+  double internode_volume(const std::vector<double>& weights, const std::vector<int>& rank_node);
+
+  /**
+   * Create a communicator with ranks reordered according to the communication graph, so that heavily communicating
+   * logical ranks end up on the same node. Rank `i` in the new communicator plays the role of logical rank `i` of the graph.
+   *
+   * @param comm - MPI communicator to reorder
+   * @param weights - dense row-major `n x n` matrix of communication weights, identical on all processes
+   * @return reordered communicator
+   */
+  MPI_Comm reorder_communicator(MPI_Comm comm, const std::vector<double>& weights);
+
+  /**
+   * MPI runtime context. Topology is discovered with a single MPI_Allgather of process locations, node and NUMA ranks
+   * are derived from it locally. Communicators of the three levels (NUMA domain, node, internode) and devices
+   * communicators are created on first use: the first use of each of them is collective over its members only (domain
+   * communicator: over the node) and has to happen in the same order on all of them.
    */
   struct mpi_context {
     static inline mpi_context& context() {
       static mpi_context instance(MPI_COMM_WORLD);
+      // binding of the job is checked once, when the global context is set up
+      static bool binding_checked = (instance.check_startup_binding(), true);
+      (void)binding_checked;
       return instance;
     }
 
@@ -81,26 +274,194 @@ namespace green::utils {
         node_size = 1;
         internode_rank = 0;
         internode_size = 1;
+        domain_rank = 0;
+        domain_size = 1;
+        interdomain_rank = 0;
+        interdomain_size = 1;
       } else {
         MPI_Comm_rank(global, &global_rank);
         MPI_Comm_size(global, &global_size);
-        setup_communicators(global, global_rank, node_comm, node_rank, node_size, internode_comm, internode_rank, internode_size);
+        discover_topology();
       }
     }
 
+    /**
+     * Build context on top of a communicator reordered according to communication graph of the algorithm.
+     *
+     * @param comm - MPI communicator
+     * @param comm_weights - dense row-major matrix of communication weights between logical ranks
+     */
+    mpi_context(MPI_Comm comm, const std::vector<double>& comm_weights) : mpi_context(reorder_communicator(comm, comm_weights)) {
+      // reordered communicator is owned by the context
+      _owns_global = true;
+    }
+
+    mpi_context(const mpi_context&)            = delete;
+    mpi_context& operator=(const mpi_context&) = delete;
+
+    ~mpi_context() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (finalized) return;
+      _workspace.reset();
+      _barrier.reset();
+      domain_comm.free();
+      interdomain_comm.free();
+      node_comm.free();
+      internode_comm.free();
+      for (auto& [count, comm] : _devices) comm.free();
+      if (_owns_global) MPI_Comm_free(&global);
+    }
+
     MPI_Comm global;
     int      global_rank;
     int      global_size;
 
-    MPI_Comm node_comm;
-    int      node_rank;
-    int      node_size;
+    // processes sharing the host, created on first use
+    lazy_communicator node_comm;
+    int               node_rank;
+    int               node_size;
+
+    // lowest ranks of every node, MPI_COMM_NULL on other processes, created on first use
+    lazy_communicator internode_comm;
+    int               internode_rank;
+    int               internode_size;
+
+    // processes of the node sharing a NUMA domain (socket), created on first use
+    lazy_communicator domain_comm;
+    int               domain_rank;
+    int               domain_size;
+
+    // lowest ranks of every NUMA domain of the node, MPI_COMM_NULL on other processes, created on first use;
+    // `interdomain_rank` is the index of the domain within the node on every process
+    lazy_communicator interdomain_comm;
+    int               interdomain_rank;
+    int               interdomain_size;
+
+    /**
+     * Communicator of the first `devices_per_node` processes of every node, one process per device. Created on first use
+     * for a given number of devices, hence the first call is collective over the processes with
+     * `node_rank < devices_per_node`.
+     *
+     * @param devices_per_node - number of devices on each node
+     * @return devices communicator, MPI_COMM_NULL on processes that do not drive a device
+     */
+    MPI_Comm devices_comm(int devices_per_node);
+
+    /**
+     * Split processes into `groups` groups of equal size and create both the intra-group and the cross-group
+     * communicators. Collective over `global`.
+     *
+     * @param groups - number of groups, has to divide `global_size`
+     * @param placement - node aligned or interleaved placement of groups
+     * @return groups of the current process
+     */
+    process_groups split_groups(int groups, group_placement placement = group_placement::node_aligned) const;
+
+    /**
+     * Gather affinity masks of the processes of every node, detect unpinned processes, overlapping core sets and
+     * oversubscription, and write the binding map to the log on the root. If requested, unpinned or overlapping
+     * processes of a node are re-pinned into disjoint chunks of its cores ordered by NUMA node, together with the helper
+     * threads of green-utils. Collective over `global`.
+     *
+     * @param repin - re-pin processes of nodes with unpinned or overlapping processes
+     * @return binding status of the job and cores of the current process
+     */
+    binding_report check_binding(bool repin = false);
 
-    MPI_Comm internode_comm;
-    int      internode_rank;
-    int      internode_size;
+    /**
+     * @return locations of all processes of the global communicator
+     */
+    const std::vector<process_location>& locations() const { return _locations; }
+
+    /**
+     * Shared memory barrier over the node communicator. Created on first use, hence the first call is collective
+     * over `node_comm`.
+     *
+     * @return node-level barrier
+     */
+    node_barrier& barrier() {
+      if (!_barrier) _barrier = std::make_unique<node_barrier>(node_comm);
+      return *_barrier;
+    }
+
+    /**
+     * Scratch shared memory used by node-level collectives. Created on first use with `workspace_size` bytes, hence the
+     * first call is collective over `node_comm`.
+     *
+     * @return node shared workspace
+     */
+    shared_workspace& workspace() {
+      if (!_workspace) {
+        _workspace = std::make_unique<shared_workspace>(node_comm, workspace_bytes());
+        if (_memory_budget) timing::get_instance().counter("memory budget workspace bytes") = workspace_bytes();
+      }
+      return *_workspace;
+    }
+
+    /**
+     * Size of the node shared workspace: `workspace_size` limited to half of the node memory budget, but large enough for
+     * node-level collectives to exchange one cache line between every pair of node processes.
+     *
+     * @return workspace size in bytes
+     */
+    size_t workspace_bytes() const {
+      if (!_memory_budget) return workspace_size;
+      size_t minimal = cache_line_size * node_size * node_size;
+      return std::max(std::min(workspace_size, _memory_budget / 2), minimal);
+    }
+
+    /**
+     * Memory available to each process of the node for temporary buffers of collectives: node memory budget without
+     * the shared workspace, divided between node processes.
+     *
+     * @return number of bytes, unlimited if no memory budget is set
+     */
+    size_t temporary_budget() const {
+      if (!_memory_budget) return std::numeric_limits<size_t>::max();
+      size_t workspace = workspace_bytes();
+      return std::max<size_t>(_memory_budget > workspace ? (_memory_budget - workspace) / node_size : 0, cache_line_size);
+    }
+
+    /**
+     * Set memory budget of a node for temporary buffers of green-utils collectives. The budget also limits the node
+     * workspace, hence it can only be set before the first use of the workspace.
+     *
+     * @param bytes - budget in bytes, 0 means no limit
+     */
+    void set_memory_budget(size_t bytes) {
+      if (_workspace && bytes != _memory_budget)
+        throw mpi_shared_memory_error("Memory budget cannot be changed after the node workspace has been created.");
+      _memory_budget = bytes;
+    }
+
+    size_t memory_budget() const { return _memory_budget; }
+
+    // size of the node shared workspace in bytes
+    size_t workspace_size = size_t(1) << 26;
+
+  private:
+    void             discover_topology();
+    void             assign_domains();
+    std::vector<int> node_members(int rank) const;
+    MPI_Comm         create_domain_communicator();
+    // startup check of the global context, `GREEN_CHECK_BINDING=0` disables it and `GREEN_CHECK_BINDING=repin` re-pins
+    void             check_startup_binding();
+
+    std::vector<process_location>     _locations;
+    // node index, rank within the node and NUMA domain index within the node of every process of the global communicator
+    std::vector<int>                  _node_index;
+    std::vector<int>                  _node_ranks;
+    std::vector<int>                  _domain_index;
+    std::map<int, lazy_communicator>  _devices;
+    std::unique_ptr<node_barrier>     _barrier;
+    std::unique_ptr<shared_workspace> _workspace;
+    size_t                            _memory_budget = 0;
+    bool                              _owns_global   = false;
   };
 
+  inline void timing::print(const mpi_context& ctx) { print(ctx.global); }
+
   /**
    * Summation of memory contigious matrices.
    *
@@ -134,8 +495,130 @@ namespace green::utils {
     return matrix_sum_op;
   }
 
+  namespace detail {
+    // functor used by the MPI operation created for the functor type, set on every call of `functor_operation`
+    template <typename Op>
+    std::optional<Op>& functor_instance() {
+      static std::optional<Op> instance;
+      return instance;
+    }
+
+    /**
+     * MPI user function that combines arrays element-wise with a functor. Pointers do not alias, so the loop is
+     * vectorized by the compiler for simple functors.
+     */
+    template <typename T, typename Op>
+    void functor_combine(void* in, void* inout, int* len, MPI_Datatype* dt) {
+      int size;
+      MPI_Type_size(*dt, &size);
+      size_t              n   = *len * static_cast<size_t>(size / sizeof(T));
+      const T* __restrict src = static_cast<const T*>(in);
+      T* __restrict       dst = static_cast<T*>(inout);
+      const Op&           op  = *functor_instance<Op>();
+      for (size_t i = 0; i < n; ++i) dst[i] = op(src[i], dst[i]);
+    }
+  }  // namespace detail
+
+  /**
+   * MPI operation that combines elements of type T with a binary functor or lambda, `op(a, b)` should return the
+   * combination of `a` and `b`. The operation is created once per functor type and cached, the functor itself is stored
+   * on every call, so stateful functors (e.g. weights) use the state passed to the latest call. The returned operation
+   * should therefore be used by the reduction that follows the call before `functor_operation` is called again for the
+   * same functor type with a different state, in particular not by concurrent or pending non-blocking reductions.
+   * The same functor can be passed to `node_reduce`, `node_allreduce` and `hierarchical_allreduce`.
+   *
+   * The operation works with any datatype made of contiguous elements of type T, e.g. `mpi_type<T>::type`,
+   * `record_type<T>()` or `create_matrix_datatype<T>(N)`.
+   *
+   * @tparam T - element type
+   * @tparam Op - binary functor type
+   * @tparam Commute - whether the operation is commutative
+   * @param op - functor
+   * @return cached MPI operation
+   */
+  template <typename T, typename Op, bool Commute = true>
+  MPI_Op functor_operation(const Op& op = Op()) {
+    static_assert(std::is_trivially_copyable_v<T>, "Functor operation requires trivially copyable type.");
+    detail::functor_instance<Op>().emplace(op);
+    static MPI_Op mpi_op = [] {
+      MPI_Op result;
+      MPI_Op_create(detail::functor_combine<T, Op>, Commute, &result);
+      return result;
+    }();
+    return mpi_op;
+  }
+
+  /**
+   * MPI datatype for a trivially copyable record type that is transferred as a contiguous sequence of bytes.
+   * Datatype is created and committed on the first use.
+   *
+   * @tparam T - record type
+   * @return committed MPI datatype
+   */
+  template <typename T>
+  MPI_Datatype record_type() {
+    static_assert(std::is_trivially_copyable_v<T>, "Record type should be trivially copyable.");
+    static MPI_Datatype dt_record = [] {
+      MPI_Datatype dt;
+      MPI_Type_contiguous(sizeof(T), MPI_BYTE, &dt);
+      MPI_Type_commit(&dt);
+      return dt;
+    }();
+    return dt_record;
+  }
+
+  /**
+   * All-to-all exchange with variable counts that are not limited by the int range. Falls back from `MPI_Alltoallv` to
+   * point-to-point communication in chunks of at most INT_MAX elements when counts or displacements overflow int.
+   *
+   * @tparam T - element type
+   * @param send - send buffer, data for rank `p` is stored contiguously after data for ranks `0..p-1`
+   * @param send_counts - number of elements sent to each rank
+   * @param recv - receive buffer, data from rank `p` is stored after data from ranks `0..p-1`
+   * @param recv_counts - number of elements received from each rank
+   * @param dt - MPI datatype of one element
+   * @param comm - MPI communicator
+   */
+  template <typename T>
+  void alltoallv(const T* send, const std::vector<size_t>& send_counts, T* recv, const std::vector<size_t>& recv_counts,
+                 MPI_Datatype dt, MPI_Comm comm) {
+    watchdog_guard guard("alltoallv");
+    int size;
+    MPI_Comm_size(comm, &size);
+    std::vector<size_t> send_displs(size + 1, 0), recv_displs(size + 1, 0);
+    for (int p = 0; p < size; ++p) {
+      send_displs[p + 1] = send_displs[p] + send_counts[p];
+      recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+    }
+    if (send_displs[size] <= INT_MAX && recv_displs[size] <= INT_MAX) {
+      std::vector<int> scounts(send_counts.begin(), send_counts.end()), rcounts(recv_counts.begin(), recv_counts.end());
+      std::vector<int> sdispls(send_displs.begin(), send_displs.end() - 1), rdispls(recv_displs.begin(), recv_displs.end() - 1);
+      if (MPI_Alltoallv(send, scounts.data(), sdispls.data(), dt, recv, rcounts.data(), rdispls.data(), dt, comm) != MPI_SUCCESS)
+        throw mpi_communication_error("MPI_Alltoallv failed.");
+      return;
+    }
+    std::vector<MPI_Request> requests;
+    for (int p = 0; p < size; ++p) {
+      for (size_t offset = 0; offset < recv_counts[p]; offset += INT_MAX) {
+        int count = static_cast<int>(std::min<size_t>(INT_MAX, recv_counts[p] - offset));
+        requests.emplace_back();
+        MPI_Irecv(recv + recv_displs[p] + offset, count, dt, p, 0, comm, &requests.back());
+      }
+    }
+    for (int p = 0; p < size; ++p) {
+      for (size_t offset = 0; offset < send_counts[p]; offset += INT_MAX) {
+        int count = static_cast<int>(std::min<size_t>(INT_MAX, send_counts[p] - offset));
+        requests.emplace_back();
+        MPI_Isend(send + send_displs[p] + offset, count, dt, p, 0, comm, &requests.back());
+      }
+    }
+    if (MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+      throw mpi_communication_error("Large-count all-to-all exchange failed.");
+  }
+
   template <typename T>
   void allreduce(void* in, T* inout, int count, MPI_Datatype dt, MPI_Op op, MPI_Comm comm) {
+    watchdog_guard guard("allreduce");
     void* in_ptr = in;
     int   rank;
     MPI_Comm_rank(comm, &rank);
@@ -211,7 +694,7 @@ namespace green::utils {
     // This will be called by all processes to query the pointer to the shared area on local zero process.
     if (MPI_Win_shared_query(shared_win, 0, &buffer_size, &disp_unit, ptr_to_shared_mem) != MPI_SUCCESS)
       throw mpi_shared_memory_error("Failed extracting pointer to the shared area)");
-    MPI_Barrier(context.node_comm);
+    context.barrier().wait();
   }
 
   /**
@@ -219,6 +702,7 @@ namespace green::utils {
    */
   template <typename T>
   void broadcast(T* object, size_t element_counts, MPI_Comm comm, int root_rank) {
+    watchdog_guard guard("broadcast");
     int size;
     MPI_Comm_size(comm, &size);
     if (size > 1) {
@@ -231,5 +715,67 @@ namespace green::utils {
     }
   }
 
+  /**
+   * Inclusive element-wise prefix sum of values over processes of a communicator.
+   *
+   * @tparam T - element type
+   * @param values - values of the current process
+   * @param comm - MPI communicator
+   * @param total - optional output for the element-wise sum over all processes
+   * @return sum of values on processes with rank less or equal to the current one
+   */
+  template <typename T>
+  std::vector<T> scan(const std::vector<T>& values, MPI_Comm comm, std::vector<T>* total = nullptr) {
+    std::vector<T> result(values.size());
+    if (MPI_Scan(values.data(), result.data(), values.size(), mpi_type<T>::type, MPI_SUM, comm) != MPI_SUCCESS)
+      throw mpi_communication_error("MPI_Scan failed.");
+    if (total) {
+      total->resize(values.size());
+      MPI_Allreduce(values.data(), total->data(), values.size(), mpi_type<T>::type, MPI_SUM, comm);
+    }
+    return result;
+  }
+
+  /**
+   * Exclusive element-wise prefix sum of values over processes of a communicator, e.g. global offsets of distributed data.
+   *
+   * @tparam T - element type
+   * @param values - values of the current process
+   * @param comm - MPI communicator
+   * @param total - optional output for the element-wise sum over all processes
+   * @return sum of values on processes with rank less than the current one, zeros on the first process
+   */
+  template <typename T>
+  std::vector<T> exscan(const std::vector<T>& values, MPI_Comm comm, std::vector<T>* total = nullptr) {
+    std::vector<T> result(values.size(), T(0));
+    if (MPI_Exscan(values.data(), result.data(), values.size(), mpi_type<T>::type, MPI_SUM, comm) != MPI_SUCCESS)
+      throw mpi_communication_error("MPI_Exscan failed.");
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    // result of MPI_Exscan is undefined on the first process
+    if (!rank) std::fill(result.begin(), result.end(), T(0));
+    if (total) {
+      total->resize(values.size());
+      MPI_Allreduce(values.data(), total->data(), values.size(), mpi_type<T>::type, MPI_SUM, comm);
+    }
+    return result;
+  }
+
+  template <typename T>
+  T scan(T value, MPI_Comm comm, T* total = nullptr) {
+    std::vector<T> sum;
+    T              result = scan(std::vector<T>{value}, comm, total ? &sum : nullptr)[0];
+    if (total) *total = sum[0];
+    return result;
+  }
+
+  template <typename T>
+  T exscan(T value, MPI_Comm comm, T* total = nullptr) {
+    std::vector<T> sum;
+    T              result = exscan(std::vector<T>{value}, comm, total ? &sum : nullptr)[0];
+    if (total) *total = sum[0];
+    return result;
+  }
+
 }  // namespace green::utils
 #endif  // GREEN_UTILS_MPI_UTILS_H
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_MPI_WORKSPACE_H
+#define GREEN_UTILS_MPI_WORKSPACE_H
+
+#include <mpi.h>
+
+#include <cstddef>
+
+#include "except.h"
+
+namespace green::utils {
+
+  /**
+   * Cache line size used to align data written concurrently by different processes
+   */
+  inline constexpr size_t cache_line_size = 64;
+
+  /**
+   * @brief Scratch shared memory region of a node.
+   *
+   * Contiguous shared memory window allocated on the 0-th process of a node-local communicator. Node-level collectives
+   * use it as a staging area, splitting large messages into chunks that fit into the workspace.
+   */
+  class shared_workspace {
+  public:
+    /**
+     * Allocate workspace. Collective over `comm`.
+     *
+     * @param comm - communicator of processes sharing memory
+     * @param bytes - size of the workspace in bytes
+     */
+    shared_workspace(MPI_Comm comm, size_t bytes) {
+      int rank;
+      MPI_Comm_rank(comm, &rank);
+      if (MPI_Win_allocate_shared(rank ? 0 : bytes, 1, MPI_INFO_NULL, comm, &_data, &_win) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed allocating shared workspace.");
+      MPI_Aint size;
+      int      disp_unit;
+      if (MPI_Win_shared_query(_win, 0, &size, &disp_unit, &_data) != MPI_SUCCESS)
+        throw mpi_shared_memory_error("Failed extracting pointer to the shared workspace.");
+      _size = size;
+    }
+
+    shared_workspace(const shared_workspace&)            = delete;
+    shared_workspace& operator=(const shared_workspace&) = delete;
+
+    ~shared_workspace() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (!finalized && _win != MPI_WIN_NULL) MPI_Win_free(&_win);
+    }
+
+    template <typename T>
+    T* as() {
+      return static_cast<T*>(_data);
+    }
+
+    void*   data() { return _data; }
+    size_t  size() const { return _size; }
+    MPI_Win win() const { return _win; }
+
+  private:
+    void*   _data = nullptr;
+    size_t  _size = 0;
+    MPI_Win _win  = MPI_WIN_NULL;
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_MPI_WORKSPACE_H
@@ -24,6 +24,7 @@
 #include <mpi.h>
 
 #include <cstring>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -36,6 +37,8 @@
 
 namespace green::utils {
 
+  struct mpi_context;
+
   struct event_t {
     event_t() : start(0), duration(0), active(false) {}
     event_t(double start_, double duration_) : start(start_), duration(duration_), active(false){};
@@ -160,6 +163,7 @@ namespace green::utils {
       }
       _current_event->active = true;
       _current_event->start  = time();
+      if (_observer) _observer(name, true);
     }
 
     /**
@@ -176,7 +180,7 @@ namespace green::utils {
       _current_event->duration += time1 - _current_event->start;
       _current_event->active = false;
       _current_event         = _current_event->parent;
-
+      if (_observer) _observer("", false);
     }
 
     /**
@@ -187,6 +191,9 @@ namespace green::utils {
       for (auto& kv : _root_events) {
         print_event(kv.first, "", *kv.second);
       }
+      for (auto& kv : _counters) {
+        std::cout << std::setw(45) << std::left << ("Counter '" + kv.first + "'") << kv.second << std::endl;
+      }
       std::cout << "=====================" << std::endl;
     }
 
@@ -218,12 +225,21 @@ namespace green::utils {
         event_t& e = *_root_events[name];
         print_event(comm, id, np, name, "", e);
       }
+      print_counters(comm, id, np);
       if (!id) {
         std::cout << "=====================" << std::endl;
       }
       std::cout << std::setprecision(old_precision);
     }
 
+    /**
+     * Print statistics for all observed events across processes of the global communicator of the context, defined in
+     * mpi_utils.h.
+     *
+     * @param ctx - MPI context
+     */
+    void print(const mpi_context& ctx);
+
     /**
      * Return timing event
      * @param event_name - event name
@@ -243,12 +259,30 @@ namespace green::utils {
       return *_root_events[event_name];
     };
 
+    /**
+     * Return named counter for non-time statistics (sizes, hit counts, etc.), counters are printed after events
+     * @param counter_name - counter name
+     * @return counter value by name
+     */
+    double& counter(const std::string& counter_name) { return _counters[counter_name]; }
+
+    using observer_t = std::function<void(const std::string& name, bool started)>;
+
+    /**
+     * Set callback that is notified when an event starts (with its name) or ends, empty callback removes it
+     * @param observer - callback
+     */
+    void set_observer(observer_t observer) { _observer = std::move(observer); }
+
   private:
     // name of the timer
     std::string                    _name;
     // registered root timing events
     std::map<std::string, std::unique_ptr<event_t> > _root_events;
     event_t*                       _current_event = nullptr;
+    // registered counters
+    std::map<std::string, double>  _counters;
+    observer_t                     _observer;
 
     /**
      * @return time in seconds since some arbitrary time in the past;
@@ -285,6 +319,33 @@ namespace green::utils {
       }
     }
 
+    /**
+     * \brief Print max, min and average value of each counter across the communicator, we assume that root core have all
+     * counters
+     */
+    void print_counters(MPI_Comm comm, int id, int np) {
+      int num_counters = _counters.size();
+      MPI_Bcast(&num_counters, 1, MPI_INT, 0, comm);
+      auto it = _counters.begin();
+      for (int i = 0; i < num_counters; ++i) {
+        std::string name = "";
+        if (!id) {
+          name = it->first;
+          std::advance(it, 1);
+        }
+        get_name(comm, name);
+        double value = _counters[name];
+        double max, min, sum;
+        MPI_Reduce(&value, &max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+        MPI_Reduce(&value, &min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+        MPI_Reduce(&value, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+        if (!id) {
+          std::cout << std::setw(45) << std::left << ("Counter '" + name + "'") << " " << std::setw(13) << max << " "
+                    << std::setw(13) << min << " " << std::setw(13) << sum / np << std::endl;
+        }
+      }
+    }
+
   };
 }  // namespace green::utils
 #endif  // GREEN_UTILS_TIMING_H
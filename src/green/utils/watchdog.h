@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2024 University of Michigan
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the “Software”), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ * FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GREEN_UTILS_WATCHDOG_H
+#define GREEN_UTILS_WATCHDOG_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+#include "except.h"
+#include "timing.h"
+
+namespace green::utils {
+
+  /**
+   * @brief Watchdog for hanging collectives and slow timing events.
+   *
+   * When started, a background thread checks how long the current process has been inside a green-utils collective
+   * (marked with `watchdog_guard`) or inside the innermost event of the observed `timing` object. Once this exceeds the
+   * timeout, the thread queries all other processes through a duplicated communicator with non-blocking probes and prints
+   * a report to stderr: for every process the collective it is in (or that it has not entered the stalled collective yet)
+   * and its current timing event. Every stall is reported once.
+   *
+   * Requires MPI initialized with MPI_THREAD_MULTIPLE. When the watchdog is not running, guards cost one atomic load.
+   */
+  class watchdog {
+    static constexpr int query_tag = 1;
+    static constexpr int state_tag = 2;
+
+    // queries some process has not received yet, the oldest are cancelled beyond this limit
+    static constexpr size_t max_pending_queries = 8;
+
+    // state of a process sent in reply to a query
+    struct state_msg {
+      int    round;
+      int    inside;
+      long   entered;
+      double elapsed;
+      double event_elapsed;
+      char   collective[64];
+      char   event[192];
+    };
+
+    // query sent to all other processes, the round buffer has to outlive the send requests
+    struct pending_query {
+      int                      round;
+      std::vector<MPI_Request> requests;
+    };
+
+  public:
+    /**
+     * Global watchdog used by green-utils collectives
+     */
+    static watchdog& get_instance() {
+      static watchdog instance;
+      return instance;
+    }
+
+    watchdog() = default;
+
+    watchdog(const watchdog&)            = delete;
+    watchdog& operator=(const watchdog&) = delete;
+
+    ~watchdog() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (!finalized) stop();
+    }
+
+    /**
+     * Start background thread. Collective over `comm`.
+     *
+     * @param comm - communicator of processes that are checked
+     * @param timeout - time in seconds after which a collective or an event is reported
+     * @param statistic - timing object whose events are observed
+     * @param poll - interval in seconds between checks
+     */
+    void start(MPI_Comm comm, double timeout, timing& statistic = timing::get_instance(), double poll = 0.01) {
+      if (_running) throw mpi_communicator_error("Watchdog is already running.");
+      int provided;
+      MPI_Query_thread(&provided);
+      if (provided < MPI_THREAD_MULTIPLE) throw mpi_communicator_error("Watchdog requires MPI_THREAD_MULTIPLE support.");
+      MPI_Comm_dup(comm, &_comm);
+      MPI_Comm_rank(_comm, &_rank);
+      MPI_Comm_size(_comm, &_size);
+      _timeout   = timeout;
+      _poll      = poll;
+      _statistic = &statistic;
+      _statistic->set_observer([this](const std::string& name, bool started) { observe(name, started); });
+      _stop    = false;
+      _running = true;
+      _thread  = std::thread([this] { run(); });
+    }
+
+    /**
+     * Stop background thread. Collective over the communicator passed to `start()`.
+     */
+    void stop() {
+      if (!_running) return;
+      _running = false;
+      MPI_Barrier(_comm);
+      _stop = true;
+      _thread.join();
+      _statistic->set_observer({});
+      // queries to processes that never answered are cancelled
+      while (!_queries.empty()) cancel_oldest_query();
+      MPI_Barrier(_comm);
+      // drop queries and replies that were not processed before the threads stopped
+      for (int flag = 1; flag;) {
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, _comm, &flag, &status);
+        if (!flag) break;
+        int count;
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        std::vector<char> buffer(count);
+        MPI_Recv(buffer.data(), count, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG, _comm, MPI_STATUS_IGNORE);
+      }
+      MPI_Comm_free(&_comm);
+    }
+
+    bool running() const { return _running.load(std::memory_order_relaxed); }
+
+    /**
+     * Mark entry into a collective operation, collectives called from within another collective are not tracked
+     */
+    void enter(const char* name) {
+      std::lock_guard lock(_mutex);
+      if (_depth++) return;
+      ++_entered;
+      _inside     = true;
+      _collective = name;
+      _enter_time = MPI_Wtime();
+    }
+
+    /**
+     * Mark exit from the current collective operation
+     */
+    void leave() {
+      std::lock_guard lock(_mutex);
+      if (--_depth == 0) _inside = false;
+    }
+
+    /**
+     * @return last printed report, empty if nothing has been reported
+     */
+    std::string last_report() const {
+      std::lock_guard lock(_mutex);
+      return _last_report;
+    }
+
+  private:
+    MPI_Comm                                    _comm = MPI_COMM_NULL;
+    int                                         _rank = 0;
+    int                                         _size = 1;
+    double                                      _timeout;
+    double                                      _poll;
+    timing*                                     _statistic = nullptr;
+    std::atomic<bool>                           _running{false};
+    std::atomic<bool>                           _stop{false};
+    std::thread                                 _thread;
+    mutable std::mutex                          _mutex;
+    // collective state
+    long                                        _entered    = 0;
+    int                                         _depth      = 0;
+    bool                                        _inside     = false;
+    const char*                                 _collective = "";
+    double                                      _enter_time = 0.0;
+    // stack of observed timing events with their start times
+    std::vector<std::pair<std::string, double>> _events;
+    // last reported collective and event, every stall is reported once
+    long                                        _reported_collective = 0;
+    double                                      _reported_event      = -1.0;
+    int                                         _round               = 0;
+    std::deque<pending_query>                   _queries;
+    std::string                                 _last_report;
+
+    void observe(const std::string& name, bool started) {
+      std::lock_guard lock(_mutex);
+      if (started) {
+        _events.emplace_back(name, MPI_Wtime());
+      } else if (!_events.empty()) {
+        _events.pop_back();
+      }
+    }
+
+    state_msg local_state(int round) const {
+      std::lock_guard lock(_mutex);
+      state_msg       state{};
+      double          now = MPI_Wtime();
+      state.round         = round;
+      state.inside        = _inside;
+      state.entered       = _entered;
+      state.elapsed       = _inside ? now - _enter_time : 0.0;
+      state.event_elapsed = _events.empty() ? 0.0 : now - _events.back().second;
+      std::strncpy(state.collective, _collective, sizeof(state.collective) - 1);
+      std::string path;
+      for (auto& [name, start] : _events) path += (path.empty() ? "" : "/") + name;
+      std::strncpy(state.event, path.c_str(), sizeof(state.event) - 1);
+      return state;
+    }
+
+    // answer queries of other processes
+    void serve() {
+      for (int flag = 1; flag;) {
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, query_tag, _comm, &flag, &status);
+        if (!flag) break;
+        int round;
+        MPI_Recv(&round, 1, MPI_INT, status.MPI_SOURCE, query_tag, _comm, MPI_STATUS_IGNORE);
+        state_msg state = local_state(round);
+        MPI_Send(&state, sizeof(state), MPI_BYTE, status.MPI_SOURCE, state_tag, _comm);
+      }
+    }
+
+    // check whether the current collective or the innermost event has exceeded timeout
+    bool stalled(std::string& what) {
+      std::lock_guard lock(_mutex);
+      double          now = MPI_Wtime();
+      if (_inside && now - _enter_time > _timeout && _reported_collective != _entered) {
+        _reported_collective = _entered;
+        what                 = std::string("collective '") + _collective + "' #" + std::to_string(_entered);
+        return true;
+      }
+      if (!_events.empty() && now - _events.back().second > _timeout && _reported_event != _events.back().second) {
+        _reported_event = _events.back().second;
+        what            = "event '" + _events.back().first + "'";
+        return true;
+      }
+      return false;
+    }
+
+    void cancel_oldest_query() {
+      for (auto& request : _queries.front().requests) {
+        if (request == MPI_REQUEST_NULL) continue;
+        MPI_Cancel(&request);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+      }
+      _queries.pop_front();
+    }
+
+    // release queries that have been delivered and bound the number of queries still in flight
+    void reap_queries() {
+      while (!_queries.empty()) {
+        int done;
+        MPI_Testall(int(_queries.front().requests.size()), _queries.front().requests.data(), &done, MPI_STATUSES_IGNORE);
+        if (!done) break;
+        _queries.pop_front();
+      }
+      while (_queries.size() >= max_pending_queries) cancel_oldest_query();
+    }
+
+    void report(const std::string& what) {
+      int                    round = ++_round;
+      std::vector<state_msg> states(_size);
+      std::vector<bool>      received(_size, false);
+      reap_queries();
+      pending_query& query = _queries.emplace_back(pending_query{round, std::vector<MPI_Request>(_size - 1)});
+      for (int p = 0, i = 0; p < _size; ++p) {
+        if (p == _rank) continue;
+        MPI_Isend(&query.round, 1, MPI_INT, p, query_tag, _comm, &query.requests[i++]);
+      }
+      states[_rank]   = local_state(round);
+      received[_rank] = true;
+      int    missing  = _size - 1;
+      double deadline = MPI_Wtime() + _timeout;
+      while (missing > 0 && MPI_Wtime() < deadline && !_stop) {
+        serve();
+        MPI_Status status;
+        int        flag;
+        MPI_Iprobe(MPI_ANY_SOURCE, state_tag, _comm, &flag, &status);
+        if (!flag) {
+          std::this_thread::sleep_for(std::chrono::duration<double>(_poll));
+          continue;
+        }
+        state_msg state;
+        MPI_Recv(&state, sizeof(state), MPI_BYTE, status.MPI_SOURCE, state_tag, _comm, MPI_STATUS_IGNORE);
+        if (state.round != round || received[status.MPI_SOURCE]) continue;
+        states[status.MPI_SOURCE]   = state;
+        received[status.MPI_SOURCE] = true;
+        --missing;
+      }
+      // queries to processes that did not answer stay pending until they are delivered, cancelled or the watchdog stops
+      // collective the reporting process is stuck in, if any
+      long               entered = states[_rank].inside ? states[_rank].entered : 0;
+      std::ostringstream ss;
+      ss << "Watchdog on rank " << _rank << ": " << what << " exceeded " << _timeout << " s." << std::endl;
+      for (int p = 0; p < _size; ++p) {
+        ss << "  rank " << p << ": ";
+        if (!received[p]) {
+          ss << "did not respond";
+        } else if (states[p].inside) {
+          ss << "in collective '" << states[p].collective << "' #" << states[p].entered << " for " << states[p].elapsed << " s";
+        } else {
+          ss << (states[p].entered < entered ? "has not entered collective #" + std::to_string(entered) : "not in a collective");
+          if (states[p].entered) ss << ", last collective '" << states[p].collective << "' #" << states[p].entered;
+        }
+        if (states[p].event[0]) ss << ", event '" << states[p].event << "' for " << states[p].event_elapsed << " s";
+        ss << std::endl;
+      }
+      std::cerr << ss.str() << std::flush;
+      std::lock_guard lock(_mutex);
+      _last_report = ss.str();
+    }
+
+    void run() {
+      bound_thread binding;
+      while (!_stop) {
+        serve();
+        std::string what;
+        if (stalled(what)) report(what);
+        std::this_thread::sleep_for(std::chrono::duration<double>(_poll));
+      }
+    }
+  };
+
+  /**
+   * @brief Marks the scope of a collective operation for the global watchdog.
+   */
+  class watchdog_guard {
+  public:
+    explicit watchdog_guard(const char* name) {
+      watchdog& dog = watchdog::get_instance();
+      if (!dog.running()) return;
+      dog.enter(name);
+      _dog = &dog;
+    }
+    ~watchdog_guard() {
+      if (_dog) _dog->leave();
+    }
+    watchdog_guard(const watchdog_guard&)            = delete;
+    watchdog_guard& operator=(const watchdog_guard&) = delete;
+
+  private:
+    watchdog* _dog = nullptr;
+  };
+
+}  // namespace green::utils
+
+#endif  // GREEN_UTILS_WATCHDOG_H
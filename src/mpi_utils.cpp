@@ -3,9 +3,18 @@
  *
  */
 
+#include <green/utils/logger.h>
 #include <green/utils/mpi_utils.h>
 
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <numeric>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace green::utils {
 
@@ -66,11 +75,368 @@ namespace green::utils {
     }
     MPI_Bcast(&internode_size, 1, MPI_INT, 0, intranode_comm);
     MPI_Bcast(&internode_rank, 1, MPI_INT, 0, intranode_comm);
+    logger::get_instance().debug("Inter-node communicator has ", internode_size, " cores. Intra-node communicator has ",
+                                intranode_size, " cores.");
+  }
+
+  namespace {
+    // cpu or node list in sysfs format, e.g. "0-3,8-11"
+    std::vector<int> read_sysfs_list(const std::string& path) {
+      std::ifstream    file(path);
+      std::vector<int> list;
+      std::string      range;
+      while (std::getline(file, range, ',')) {
+        size_t dash  = range.find('-');
+        int    first = std::stoi(range.substr(0, dash));
+        int    last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int i = first; i <= last; ++i) list.push_back(i);
+      }
+      return list;
+    }
+
+    // NUMA node holding most of the cores the process is allowed to run on
+    int numa_domain() {
+      cpu_set_t mask;
+      CPU_ZERO(&mask);
+      if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return 0;
+      int best = 0, best_count = 0;
+      for (int node : read_sysfs_list("/sys/devices/system/node/online")) {
+        std::vector<int> cpus  = read_sysfs_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        int              count = std::count_if(cpus.begin(), cpus.end(), [&mask](int cpu) { return CPU_ISSET(cpu, &mask); });
+        if (count > best_count) {
+          best       = node;
+          best_count = count;
+        }
+      }
+      return best;
+    }
+  }  // namespace
+
+  std::vector<process_location> gather_locations(MPI_Comm comm) {
+    char name[MPI_MAX_PROCESSOR_NAME];
+    int  length;
+    MPI_Get_processor_name(name, &length);
+    // FNV-1a hash of the host name
+    process_location local{14695981039346656037ull, numa_domain()};
+    for (int i = 0; i < length; ++i) local.host = (local.host ^ static_cast<unsigned char>(name[i])) * 1099511628211ull;
+    int size;
+    MPI_Comm_size(comm, &size);
+    std::vector<process_location> locations(size);
+    MPI_Allgather(&local, sizeof(process_location), MPI_BYTE, locations.data(), sizeof(process_location), MPI_BYTE, comm);
+    return locations;
+  }
+
+  MPI_Comm create_group_communicator(MPI_Comm comm, const std::vector<int>& ranks, int tag) {
+    MPI_Group parent, group;
+    MPI_Comm  result;
+    MPI_Comm_group(comm, &parent);
+    MPI_Group_incl(parent, ranks.size(), ranks.data(), &group);
+    int status = MPI_Comm_create_group(comm, group, tag, &result);
+    MPI_Group_free(&group);
+    MPI_Group_free(&parent);
+    if (status != MPI_SUCCESS) throw mpi_communicator_error("Failed to create communicator from a group of processes.");
+    return result;
+  }
+
+  namespace {
+    // nodes are enumerated in order of their lowest rank
+    std::vector<int> node_indices(const std::vector<process_location>& locations) {
+      std::unordered_map<std::uint64_t, int> index;
+      std::vector<int>                       ids(locations.size());
+      for (size_t i = 0; i < locations.size(); ++i) ids[i] = index.emplace(locations[i].host, index.size()).first->second;
+      return ids;
+    }
+  }  // namespace
+
+  std::vector<int> node_ids(MPI_Comm comm) { return node_indices(gather_locations(comm)); }
+
+  void mpi_context::discover_topology() {
+    _locations  = gather_locations(global);
+    _node_index = node_indices(_locations);
+    _node_ranks.assign(global_size, 0);
+    std::vector<int> node_sizes;
+    std::vector<int> leaders;
+    for (int r = 0; r < global_size; ++r) {
+      int node = _node_index[r];
+      if (node == int(node_sizes.size())) {
+        node_sizes.push_back(0);
+        leaders.push_back(r);
+      }
+      _node_ranks[r] = node_sizes[node]++;
+    }
+    node_rank      = _node_ranks[global_rank];
+    node_size      = node_sizes[_node_index[global_rank]];
+    internode_rank = _node_index[global_rank];
+    internode_size = node_sizes.size();
+    assign_domains();
+    node_comm        = lazy_communicator([this] { return create_group_communicator(global, node_members(global_rank), 1); });
+    internode_comm   = lazy_communicator([this, leaders] {
+      return node_rank ? MPI_COMM_NULL : create_group_communicator(global, leaders, 2);
+    });
+    domain_comm      = lazy_communicator([this] { return create_domain_communicator(); });
+    interdomain_comm = lazy_communicator([this]() -> MPI_Comm {
+      if (domain_rank) return MPI_COMM_NULL;
+      std::vector<int> members;
+      for (int r : node_members(global_rank)) {
+        if (_domain_index[r] == int(members.size())) members.push_back(r);
+      }
+      return create_group_communicator(global, members, 4);
+    });
+  }
+
+  void mpi_context::assign_domains() {
+    // domains of every node are enumerated in order of their lowest rank
+    std::vector<std::unordered_map<int, int>> node_domains(internode_size);
+    _domain_index.assign(global_size, 0);
+    for (int r = 0; r < global_size; ++r) {
+      auto& domains    = node_domains[_node_index[r]];
+      _domain_index[r] = domains.emplace(_locations[r].numa, domains.size()).first->second;
+    }
+    interdomain_rank = _domain_index[global_rank];
+    interdomain_size = node_domains[internode_rank].size();
+    domain_rank      = 0;
+    domain_size      = 0;
+    for (int r : node_members(global_rank)) {
+      if (_domain_index[r] != interdomain_rank) continue;
+      if (r < global_rank) ++domain_rank;
+      ++domain_size;
+    }
+  }
+
+  binding_report mpi_context::check_binding(bool repin) {
+    binding_report   report;
+    std::vector<int> cpus = get_affinity();
+    report.cpus           = cpus;
+    if (_node_index.empty()) return report;
+    // affinity masks of all node processes
+    int              count = cpus.size();
+    std::vector<int> counts(node_size), displs(node_size, 0);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, node_comm);
+    for (int p = 1; p < node_size; ++p) displs[p] = displs[p - 1] + counts[p - 1];
+    std::vector<int> all(displs.back() + counts.back());
+    MPI_Allgatherv(cpus.data(), count, MPI_INT, all.data(), counts.data(), displs.data(), MPI_INT, node_comm);
+    std::map<int, int> usage;
+    for (int cpu : all) ++usage[cpu];
+    int  online           = read_sysfs_list("/sys/devices/system/cpu/online").size();
+    auto all_cores        = [online](int c) { return online > 0 && c >= online; };
+    report.unpinned       = node_size > 1 && std::any_of(counts.begin(), counts.end(), all_cores);
+    report.overlap        = std::any_of(usage.begin(), usage.end(), [](const auto& u) { return u.second > 1; });
+    report.oversubscribed = node_size > int(usage.size());
+    if (repin && (report.unpinned || report.overlap)) {
+      // available cores ordered by NUMA node, consecutive processes get consecutive chunks
+      std::map<int, int> cpu_numa;
+      for (int numa : read_sysfs_list("/sys/devices/system/node/online"))
+        for (int cpu : read_sysfs_list("/sys/devices/system/node/node" + std::to_string(numa) + "/cpulist")) cpu_numa[cpu] = numa;
+      std::vector<int> available;
+      for (const auto& u : usage) available.push_back(u.first);
+      std::stable_sort(available.begin(), available.end(), [&cpu_numa](int a, int b) { return cpu_numa[a] < cpu_numa[b]; });
+      size_t           total = available.size();
+      std::vector<int> mine;
+      if (total >= size_t(node_size)) {
+        mine.assign(available.begin() + total * node_rank / node_size, available.begin() + total * (node_rank + 1) / node_size);
+      } else {
+        mine.push_back(available[node_rank % total]);
+      }
+      std::sort(mine.begin(), mine.end());
+      report.repinned = thread_binding::get_instance().bind(mine);
+      if (report.repinned) report.cpus = mine;
+    }
+    int flags[4] = {report.unpinned, report.overlap, report.oversubscribed, report.repinned};
+    MPI_Allreduce(MPI_IN_PLACE, flags, 4, MPI_INT, MPI_MAX, global);
+    report.unpinned       = flags[0];
+    report.overlap        = flags[1];
+    report.oversubscribed = flags[2];
+    report.repinned       = flags[3];
+    // NUMA domains follow the new binding as long as no process has used the domain communicators yet
+    if (report.repinned) {
+      _locations = gather_locations(global);
+      int unused = !domain_comm.created() && !interdomain_comm.created();
+      MPI_Allreduce(MPI_IN_PLACE, &unused, 1, MPI_INT, MPI_LAND, global);
+      if (unused) assign_domains();
+    }
+
+    // binding map: one line per node, gathered by node leaders on the root
+    std::string line;
+    count = report.cpus.size();
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, node_comm);
+    if (!node_rank)
+      for (int p = 1; p < node_size; ++p) displs[p] = displs[p - 1] + counts[p - 1];
+    all.resize(node_rank ? 0 : displs.back() + counts.back());
+    MPI_Gatherv(report.cpus.data(), count, MPI_INT, all.data(), counts.data(), displs.data(), MPI_INT, 0, node_comm);
+    if (node_rank) return report;
+    std::vector<int> members = node_members(global_rank);
+    line                     = "node " + std::to_string(internode_rank) + ":";
+    for (int p = 0; p < node_size; ++p) {
+      line += " " + std::to_string(members[p]) + "->" +
+              cpu_list(std::vector<int>(all.begin() + displs[p], all.begin() + displs[p] + counts[p]));
+    }
+    int              length = line.size();
+    std::vector<int> lengths(internode_size), offsets(internode_size, 0);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, internode_comm);
+    std::string map;
     if (!global_rank) {
-      std::cout << "Inter-node communicator has " << internode_size << " cores. Intra-node communicator has " << intranode_size
-                << " cores." << std::endl;
-      std::cout << std::flush;
+      for (int n = 1; n < internode_size; ++n) offsets[n] = offsets[n - 1] + lengths[n - 1];
+      map.resize(offsets.back() + lengths.back());
+    }
+    MPI_Gatherv(line.data(), length, MPI_CHAR, map.data(), lengths.data(), offsets.data(), MPI_CHAR, 0, internode_comm);
+    if (global_rank) return report;
+    auto& log = logger::get_instance();
+    if (report.unpinned) log.warning("CPU binding: some processes are not pinned to cores.");
+    if (report.overlap) log.warning("CPU binding: core sets of processes on the same node overlap.");
+    if (report.oversubscribed) log.warning("CPU binding: nodes run more processes than cores.");
+    if (report.repinned)
+      log.info("CPU binding: processes have been re-pinned ",
+               report.oversubscribed ? "to single cores shared between processes." : "into disjoint NUMA-aligned core sets.");
+    log.info("CPU binding map (rank->cores):");
+    for (int n = 0; n < internode_size; ++n) log.info("  ", map.substr(offsets[n], lengths[n]));
+    return report;
+  }
+
+  void mpi_context::check_startup_binding() {
+    if (_node_index.empty()) return;
+    // environment is expected to be the same on all processes, so that all of them take part in the check
+    const char* mode = std::getenv("GREEN_CHECK_BINDING");
+    if (mode && std::string(mode) == "0") return;
+    check_binding(mode && std::string(mode) == "repin");
+  }
+
+  std::vector<int> mpi_context::node_members(int rank) const {
+    std::vector<int> members;
+    for (int r = 0; r < global_size; ++r)
+      if (_node_index[r] == _node_index[rank]) members.push_back(r);
+    return members;
+  }
+
+  MPI_Comm mpi_context::create_domain_communicator() {
+    std::vector<int> members;
+    for (int r : node_members(global_rank))
+      if (_domain_index[r] == interdomain_rank) members.push_back(r);
+#if MPI_VERSION >= 4
+    // prefer the split provided by the MPI library, as long as all processes of the node agree with the local detection
+    MPI_Info info;
+    MPI_Comm split;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "mpi_hw_resource_type", "NUMANode");
+    MPI_Comm_split_type(node_comm, MPI_COMM_TYPE_HW_GUIDED, node_rank, info, &split);
+    MPI_Info_free(&info);
+    int agree = 0;
+    if (split != MPI_COMM_NULL) {
+      int rank, size;
+      MPI_Comm_rank(split, &rank);
+      MPI_Comm_size(split, &size);
+      agree = rank == domain_rank && size == domain_size;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &agree, 1, MPI_INT, MPI_MIN, node_comm);
+    if (agree) return split;
+    if (split != MPI_COMM_NULL) MPI_Comm_free(&split);
+#endif
+    return create_group_communicator(global, members, 3);
+  }
+
+  MPI_Comm mpi_context::devices_comm(int devices_per_node) {
+    auto [it, inserted] = _devices.try_emplace(devices_per_node, [this, devices_per_node]() -> MPI_Comm {
+      if (node_rank >= devices_per_node) return MPI_COMM_NULL;
+      std::vector<int> members;
+      for (int r = 0; r < global_size; ++r)
+        if (_node_ranks[r] < devices_per_node) members.push_back(r);
+      return create_group_communicator(global, members, 16 + devices_per_node);
+    });
+    return it->second;
+  }
+
+  process_groups mpi_context::split_groups(int groups, group_placement placement) const {
+    if (groups < 1 || global_size % groups)
+      throw mpi_communicator_error("Number of groups should divide the number of processes.");
+    if (_node_index.empty()) return process_groups{};
+    int group_size = global_size / groups;
+    // processes ordered by node, so that consecutive positions share a node
+    std::vector<int> order(global_size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return _node_index[a] < _node_index[b]; });
+    auto group_of = [&](int pos) { return placement == group_placement::node_aligned ? pos / group_size : pos % groups; };
+    auto rank_of  = [&](int pos) { return placement == group_placement::node_aligned ? pos % group_size : pos / groups; };
+    auto position = [&](int group, int rank) {
+      return placement == group_placement::node_aligned ? group * group_size + rank : rank * groups + group;
+    };
+    int            pos = std::find(order.begin(), order.end(), global_rank) - order.begin();
+    process_groups result;
+    result.groups      = groups;
+    result.group_index = group_of(pos);
+    result.group_rank  = rank_of(pos);
+    result.group_size  = group_size;
+    std::vector<int> members(group_size);
+    for (int r = 0; r < group_size; ++r) members[r] = order[position(result.group_index, r)];
+    result.group_comm = create_group_communicator(global, members, 8);
+    members.resize(groups);
+    for (int g = 0; g < groups; ++g) members[g] = order[position(g, result.group_rank)];
+    result.cross_comm = create_group_communicator(global, members, 9);
+    return result;
+  }
+
+  std::vector<int> map_ranks_to_nodes(const std::vector<double>& weights, const std::vector<int>& node_sizes) {
+    size_t n = 0;
+    for (int s : node_sizes) n += s;
+    if (weights.size() != n * n) throw mpi_communicator_error("Communication graph does not match number of processes.");
+    std::vector<int>    rank_node(n, -1);
+    // symmetrized total weight of each rank, used to seed every node with the heaviest unassigned rank
+    std::vector<double> total(n, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) total[i] += weights[i * n + j] + weights[j * n + i];
+    }
+    std::vector<double> gain(n);
+    for (int node = 0; node < static_cast<int>(node_sizes.size()); ++node) {
+      std::fill(gain.begin(), gain.end(), 0.0);
+      for (int slot = 0; slot < node_sizes[node]; ++slot) {
+        int    best       = -1;
+        double best_value = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+          if (rank_node[i] >= 0) continue;
+          double value = slot == 0 ? total[i] : gain[i];
+          if (best < 0 || value > best_value) {
+            best       = i;
+            best_value = value;
+          }
+        }
+        rank_node[best] = node;
+        for (size_t i = 0; i < n; ++i) gain[i] += weights[i * n + best] + weights[best * n + i];
+      }
+    }
+    return rank_node;
+  }
+
+  double internode_volume(const std::vector<double>& weights, const std::vector<int>& rank_node) {
+    size_t n      = rank_node.size();
+    double volume = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        if (rank_node[i] != rank_node[j]) volume += weights[i * n + j];
+      }
+    }
+    return volume;
+  }
+
+  MPI_Comm reorder_communicator(MPI_Comm comm, const std::vector<double>& weights) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    std::vector<int> process_node = node_ids(comm);
+    std::vector<int> node_sizes(*std::max_element(process_node.begin(), process_node.end()) + 1, 0);
+    for (int node : process_node) ++node_sizes[node];
+    std::vector<int> rank_node = map_ranks_to_nodes(weights, node_sizes);
+    // processes of each node take logical ranks mapped onto that node in increasing order
+    std::vector<int> new_rank(size);
+    for (int node = 0; node < static_cast<int>(node_sizes.size()); ++node) {
+      int logical = 0;
+      for (int p = 0; p < size; ++p) {
+        if (process_node[p] != node) continue;
+        while (rank_node[logical] != node) ++logical;
+        new_rank[p] = logical++;
+      }
     }
+    MPI_Comm reordered;
+    if (MPI_Comm_split(comm, 0, new_rank[rank], &reordered) != MPI_SUCCESS)
+      throw mpi_communicator_error("Failed to create reordered communicator.");
+    return reordered;
   }
 
   template void matrix_sum(double*, double*, int*, MPI_Datatype*);
@@ -11,9 +11,24 @@
 #include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
 #include <thread>
 
+#include "green/utils/checkpoint.h"
+#include "green/utils/logger.h"
+#include "green/utils/mpi_accumulate.h"
+#include "green/utils/mpi_grid.h"
+#include "green/utils/mpi_io.h"
+#include "green/utils/mpi_node.h"
+#include "green/utils/mpi_redistribute.h"
 #include "green/utils/mpi_shared.h"
+#include "green/utils/mpi_sort.h"
+#include "green/utils/mpi_stream.h"
+#include "green/utils/watchdog.h"
 
 template <typename T>
 struct ref_array {
@@ -48,11 +63,11 @@ void run_test_on_shared(green::utils::shared_object<T>& shared, size_t data_size
   shared.fence();
   REQUIRE(std::all_of(shared.object().data(), shared.object().data() + shared.object().size(),
                       [](double x) { return std::abs(x) < 1e-12; }));
-  shared.fence();
+  shared.sync();
   if (green::utils::context.node_rank == 1) {
     shared.object().data()[25] = 15;
   }
-  shared.fence();
+  shared.sync();
   if (green::utils::context.node_rank != 1) {
     REQUIRE(std::abs(shared.object().data()[25] - 15.0) < 1e-12);
   }
@@ -128,6 +143,45 @@ TEST_CASE("MPI") {
                       green::utils::mpi_communicator_error);
   }
 
+  SECTION("Topology-aware reordering") {
+    // ring of 8 logical ranks with heavy links between pairs (0,5), (1,4), (2,7), (3,6)
+    size_t              n = 8;
+    std::vector<double> weights(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i) weights[i * n + (i + 1) % n] = 1.0;
+    std::vector<std::pair<int, int>> pairs{{0, 5}, {1, 4}, {2, 7}, {3, 6}};
+    for (auto [i, j] : pairs) weights[i * n + j] = weights[j * n + i] = 10.0;
+    std::vector<int> node_sizes{2, 2, 2, 2};
+    std::vector<int> identity{0, 0, 1, 1, 2, 2, 3, 3};
+    std::vector<int> mapped = green::utils::map_ranks_to_nodes(weights, node_sizes);
+    for (auto [i, j] : pairs) REQUIRE(mapped[i] == mapped[j]);
+    REQUIRE(green::utils::internode_volume(weights, mapped) < green::utils::internode_volume(weights, identity));
+    REQUIRE_THROWS_AS(green::utils::map_ranks_to_nodes(weights, {2, 2}), green::utils::mpi_communicator_error);
+
+    int                 size = green::utils::context.global_size;
+    std::vector<double> ring(size * size, 0.0);
+    for (int i = 0; i < size; ++i) ring[i * size + (size - 1 - i)] = 1.0;
+    // attribute delete callback tells when the reordered communicator is freed
+    static int freed = 0;
+    int        keyval;
+    MPI_Comm_create_keyval(
+        MPI_COMM_NULL_COPY_FN,
+        [](MPI_Comm, int, void*, void*) {
+          ++freed;
+          return MPI_SUCCESS;
+        },
+        &keyval, nullptr);
+    {
+      green::utils::mpi_context reordered(MPI_COMM_WORLD, ring);
+      REQUIRE(reordered.global_size == size);
+      REQUIRE(reordered.node_size == green::utils::context.node_size);
+      std::vector<int> ids = green::utils::node_ids(reordered.global);
+      REQUIRE(ids[reordered.global_rank] == ids[0]);
+      MPI_Comm_set_attr(reordered.global, keyval, nullptr);
+    }
+    REQUIRE(freed == 1);
+    MPI_Comm_free_keyval(&keyval);
+  }
+
   SECTION("Shared memory routines") {
     double*  data;
     MPI_Aint buffer_size = 1000 * sizeof(double);
@@ -143,6 +197,74 @@ TEST_CASE("MPI") {
     if (green::utils::context.node_rank) REQUIRE(std::abs(data[0] - 10) < 1e-12);
   }
 
+  SECTION("Node barrier") {
+    auto&    ctx = green::utils::context;
+    int*     slots;
+    MPI_Aint buffer_size = ctx.node_size * sizeof(int);
+    MPI_Win  shared_win;
+    green::utils::setup_mpi_shared_memory(&slots, buffer_size, shared_win, ctx.node_comm, ctx.node_rank);
+    for (int round = 1; round <= 100; ++round) {
+      slots[ctx.node_rank] = round * (ctx.node_rank + 1);
+      ctx.barrier().wait();
+      for (int r = 0; r < ctx.node_size; ++r) REQUIRE(slots[r] == round * (r + 1));
+      ctx.barrier().wait();
+    }
+    MPI_Win_free(&shared_win);
+    green::utils::node_barrier single(MPI_COMM_SELF);
+    REQUIRE(single.size() == 1);
+    REQUIRE_NOTHROW(single.wait());
+    // spinning is disabled when the node has fewer cores than processes
+    unsigned cores = std::thread::hardware_concurrency();
+    if (ctx.node_size > 1 && cores) {
+      bool oversubscribed = unsigned(ctx.node_size) > cores;
+      REQUIRE(ctx.barrier().spin_count() == (oversubscribed ? 0 : green::utils::node_barrier::default_spin_count));
+    }
+    green::utils::node_barrier spinning(ctx.node_comm, 10);
+    REQUIRE(spinning.spin_count() == 10);
+  }
+
+  SECTION("Node broadcast and reduce") {
+    green::utils::mpi_context ctx(MPI_COMM_WORLD);
+    // small workspace to exercise chunking
+    ctx.workspace_size = 4096;
+    int                 n     = ctx.node_size;
+    size_t              count = 10001;
+    std::vector<double> x(count, 0.0);
+    std::vector<double> expected(count);
+    std::iota(expected.begin(), expected.end(), 0.0);
+    if (ctx.node_rank == n - 1) x = expected;
+    green::utils::node_broadcast(x.data(), count, n - 1, ctx);
+    REQUIRE(x == expected);
+
+    std::transform(expected.begin(), expected.end(), x.begin(), [&ctx](double v) { return (ctx.node_rank + 1) * v; });
+    std::vector<double> y(count, -1.0);
+    green::utils::node_reduce(x.data(), y.data(), count, 0, ctx);
+    for (auto& v : expected) v *= n * (n + 1) / 2.0;
+    if (!ctx.node_rank) REQUIRE(y == expected);
+    if (ctx.node_rank) REQUIRE(std::all_of(y.begin(), y.end(), [](double v) { return v == -1.0; }));
+
+    std::vector<int> z(count, ctx.node_rank);
+    green::utils::node_allreduce(z.data(), z.data(), count, ctx, [](int a, int b) { return std::max(a, b); });
+    REQUIRE(std::all_of(z.begin(), z.end(), [n](int v) { return v == n - 1; }));
+  }
+
+  SECTION("Node all-to-all") {
+    green::utils::mpi_context ctx(MPI_COMM_WORLD);
+    ctx.workspace_size = 8192;
+    int                 n     = ctx.node_size;
+    size_t              block = 1001;
+    std::vector<double> send(n * block);
+    std::vector<double> recv(n * block, -1.0);
+    // element k of block sent from rank i to rank j is i * n + j + k * n * n
+    for (int j = 0; j < n; ++j)
+      for (size_t k = 0; k < block; ++k) send[j * block + k] = ctx.node_rank * n + j + double(k) * n * n;
+    green::utils::node_alltoall(send.data(), recv.data(), block, ctx);
+    bool transposed = true;
+    for (int i = 0; i < n; ++i)
+      for (size_t k = 0; k < block; ++k) transposed &= recv[i * block + k] == i * n + ctx.node_rank + double(k) * n * n;
+    REQUIRE(transposed);
+  }
+
   SECTION("Broadcast") {
     std::vector<double> x(100, 1.0);
     MPI_Comm            global = MPI_COMM_WORLD;
@@ -172,6 +294,730 @@ TEST_CASE("MPI") {
     run_test_on_shared(shared, shared_data.size());
   }
 
+  SECTION("Allgather into shared object") {
+    int                 rank  = green::utils::context.global_rank;
+    int                 size  = green::utils::context.global_size;
+    size_t              total = size * (size + 1) / 2;
+    size_t              first = rank * (rank + 1) / 2;
+    std::vector<double> local(rank + 1);
+    std::iota(local.begin(), local.end(), double(first));
+    green::utils::shared_object gathered(ref_array<double>{total});
+    green::utils::allgather(local.data(), local.size(), gathered);
+    std::vector<double> expected(total);
+    std::iota(expected.begin(), expected.end(), 0.0);
+    REQUIRE(std::equal(expected.begin(), expected.end(), gathered.object().data()));
+    green::utils::shared_object wrong(ref_array<double>{total + 1});
+    REQUIRE_THROWS_AS(green::utils::allgather(local.data(), local.size(), wrong), green::utils::mpi_communication_error);
+  }
+
+  SECTION("Sub-communicator contexts") {
+    int      rank = green::utils::context.global_rank;
+    MPI_Comm group;
+    MPI_Comm_split(MPI_COMM_WORLD, rank % 2, rank, &group);
+    {
+      green::utils::mpi_context sub(group);
+      int                       size  = sub.global_size;
+      size_t                    total = size * (size + 1) / 2;
+      size_t                    first = sub.global_rank * (sub.global_rank + 1) / 2;
+      std::vector<double>       local(sub.global_rank + 1);
+      std::iota(local.begin(), local.end(), double(first + rank % 2));
+      green::utils::shared_object gathered(sub, ref_array<double>{total});
+      REQUIRE(&gathered.ctx() == &sub);
+      green::utils::allgather(local.data(), local.size(), gathered);
+      std::vector<double> expected(total);
+      std::iota(expected.begin(), expected.end(), double(rank % 2));
+      REQUIRE(std::equal(expected.begin(), expected.end(), gathered.object().data()));
+      std::vector<int> data(10, sub.node_rank == 0 ? rank % 2 + 1 : 0);
+      green::utils::node_broadcast(data.data(), data.size(), 0, sub);
+      REQUIRE(std::all_of(data.begin(), data.end(), [rank](int x) { return x == rank % 2 + 1; }));
+      green::utils::timing statistic;
+      statistic.start("GROUP");
+      statistic.end();
+      REQUIRE_NOTHROW(statistic.print(sub));
+    }
+    MPI_Comm_free(&group);
+  }
+
+  SECTION("Lazy communicators") {
+    MPI_Comm shared;
+    int      shared_rank, shared_size;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &shared);
+    MPI_Comm_rank(shared, &shared_rank);
+    MPI_Comm_size(shared, &shared_size);
+    {
+      green::utils::mpi_context ctx(MPI_COMM_WORLD);
+      REQUIRE(!ctx.node_comm.created());
+      REQUIRE(!ctx.internode_comm.created());
+      REQUIRE(ctx.node_rank == shared_rank);
+      REQUIRE(ctx.node_size == shared_size);
+      REQUIRE(ctx.locations().size() == size_t(ctx.global_size));
+      int result;
+      MPI_Comm_compare(ctx.node_comm, shared, &result);
+      REQUIRE(result == MPI_CONGRUENT);
+      REQUIRE(ctx.node_comm.created());
+      REQUIRE(!ctx.internode_comm.created());
+      int nodes = ctx.node_rank ? 0 : 1;
+      MPI_Allreduce(MPI_IN_PLACE, &nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      REQUIRE(nodes == ctx.internode_size);
+      REQUIRE((ctx.internode_comm == MPI_COMM_NULL) == (ctx.node_rank != 0));
+      if (!ctx.node_rank) {
+        int rank, size;
+        MPI_Comm_rank(ctx.internode_comm, &rank);
+        MPI_Comm_size(ctx.internode_comm, &size);
+        REQUIRE(rank == ctx.internode_rank);
+        REQUIRE(size == ctx.internode_size);
+      }
+      MPI_Comm devices = ctx.devices_comm(2);
+      REQUIRE((devices == MPI_COMM_NULL) == (ctx.node_rank >= 2));
+      if (devices != MPI_COMM_NULL) {
+        int size;
+        MPI_Comm_size(devices, &size);
+        REQUIRE(size == nodes * std::min(2, ctx.node_size));
+      }
+      REQUIRE(ctx.devices_comm(2) == devices);
+      // communicators can still be used as plain MPI_Comm lvalues
+      MPI_Comm& node    = ctx.node_comm;
+      MPI_Comm* address = &ctx.node_comm;
+      REQUIRE(address == &node);
+      MPI_Comm_compare(*address, shared, &result);
+      REQUIRE(result == MPI_CONGRUENT);
+    }
+    MPI_Comm_free(&shared);
+  }
+
+  SECTION("NUMA domains") {
+    green::utils::mpi_context ctx(MPI_COMM_WORLD);
+    REQUIRE(ctx.domain_rank < ctx.domain_size);
+    REQUIRE(ctx.domain_size <= ctx.node_size);
+    REQUIRE(ctx.interdomain_rank < ctx.interdomain_size);
+    if (!ctx.node_rank) REQUIRE((ctx.domain_rank == 0 && ctx.interdomain_rank == 0));
+    int rank, size;
+    MPI_Comm_rank(ctx.domain_comm, &rank);
+    MPI_Comm_size(ctx.domain_comm, &size);
+    REQUIRE(rank == ctx.domain_rank);
+    REQUIRE(size == ctx.domain_size);
+    REQUIRE((ctx.interdomain_comm == MPI_COMM_NULL) == (ctx.domain_rank != 0));
+    int domain_total = ctx.domain_rank ? 0 : ctx.domain_size;
+    MPI_Allreduce(MPI_IN_PLACE, &domain_total, 1, MPI_INT, MPI_SUM, ctx.node_comm);
+    REQUIRE(domain_total == ctx.node_size);
+    if (!ctx.domain_rank) {
+      MPI_Comm_rank(ctx.interdomain_comm, &rank);
+      MPI_Comm_size(ctx.interdomain_comm, &size);
+      REQUIRE(rank == ctx.interdomain_rank);
+      REQUIRE(size == ctx.interdomain_size);
+    }
+  }
+
+  SECTION("Process groups") {
+    auto& ctx  = green::utils::context;
+    int   size = ctx.global_size;
+    for (int groups : {1, 2, size}) {
+      if (size % groups) {
+        REQUIRE_THROWS_AS(ctx.split_groups(groups), green::utils::mpi_communicator_error);
+        continue;
+      }
+      for (auto placement : {green::utils::group_placement::node_aligned, green::utils::group_placement::interleaved}) {
+        green::utils::process_groups split = ctx.split_groups(groups, placement);
+        int                          rank, comm_size;
+        MPI_Comm_rank(split.group_comm, &rank);
+        MPI_Comm_size(split.group_comm, &comm_size);
+        REQUIRE(rank == split.group_rank);
+        REQUIRE(comm_size == size / groups);
+        MPI_Comm_rank(split.cross_comm, &rank);
+        MPI_Comm_size(split.cross_comm, &comm_size);
+        REQUIRE(rank == split.group_index);
+        REQUIRE(comm_size == groups);
+        // all test processes share one node, hence placement follows global ranks
+        if (placement == green::utils::group_placement::node_aligned)
+          REQUIRE(split.group_index == ctx.global_rank / (size / groups));
+        else
+          REQUIRE(split.group_index == ctx.global_rank % groups);
+        int position = split.group_rank;
+        MPI_Allreduce(MPI_IN_PLACE, &position, 1, MPI_INT, MPI_MAX, split.cross_comm);
+        REQUIRE(position == split.group_rank);
+      }
+    }
+  }
+
+  SECTION("Process grid") {
+    REQUIRE(green::utils::process_grid::choose_shape(16, 16) == std::pair<int, int>{4, 4});
+    REQUIRE(green::utils::process_grid::choose_shape(32, 16, 2.0) == std::pair<int, int>{8, 4});
+    REQUIRE(green::utils::process_grid::choose_shape(12, 4, 1.0) == std::pair<int, int>{3, 4});
+    REQUIRE(green::utils::process_grid::choose_shape(7, 4) == std::pair<int, int>{7, 1});
+    auto&                      ctx = green::utils::context;
+    green::utils::process_grid grid(ctx);
+    REQUIRE(grid.rows() * grid.cols() == ctx.global_size);
+    REQUIRE(grid.rank(grid.row(), grid.col()) == ctx.global_rank);
+    int rank, size;
+    MPI_Comm_rank(grid.row_comm(), &rank);
+    MPI_Comm_size(grid.row_comm(), &size);
+    REQUIRE((rank == grid.col() && size == grid.cols()));
+    MPI_Comm_rank(grid.col_comm(), &rank);
+    MPI_Comm_size(grid.col_comm(), &size);
+    REQUIRE((rank == grid.row() && size == grid.rows()));
+    size_t m = 37, n = 23;
+    for (const auto& dist : {grid.block(m, n), grid.block_cyclic(m, n, 4, 3)}) {
+      auto [rows, cols] = dist.local_shape(grid.row(), grid.col());
+      size_t count      = 0;
+      bool   dense      = true;
+      for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+          if (dist.owner(i, j) != ctx.global_rank) continue;
+          auto [li, lj] = dist.local_index(i, j);
+          dense         = dense && li < rows && lj < cols;
+          ++count;
+        }
+      }
+      REQUIRE(dense);
+      REQUIRE(count == rows * cols);
+      MPI_Allreduce(MPI_IN_PLACE, &count, 1, MPI_UNSIGNED_LONG, MPI_SUM, ctx.global);
+      REQUIRE(count == m * n);
+    }
+    REQUIRE_THROWS_AS(green::utils::process_grid(ctx, ctx.global_size + 1, 1), green::utils::mpi_communicator_error);
+  }
+
+  SECTION("CPU binding") {
+    // re-pinning is tested on a separate context and the original binding is restored afterwards
+    green::utils::mpi_context    ctx(MPI_COMM_WORLD);
+    std::vector<int>             before = green::utils::get_affinity();
+    green::utils::binding_report report = ctx.check_binding();
+    REQUIRE(report.cpus == before);
+    REQUIRE(!report.repinned);
+    std::vector<int> cores = before;
+    std::vector<int> counts(ctx.node_size), displs(ctx.node_size, 0);
+    int              count = before.size();
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, ctx.node_comm);
+    for (int p = 1; p < ctx.node_size; ++p) displs[p] = displs[p - 1] + counts[p - 1];
+    cores.resize(displs.back() + counts.back());
+    MPI_Allgatherv(before.data(), count, MPI_INT, cores.data(), counts.data(), displs.data(), MPI_INT, ctx.node_comm);
+    std::sort(cores.begin(), cores.end());
+    size_t distinct = std::unique(cores.begin(), cores.end()) - cores.begin();
+    if (size_t(ctx.node_size) > distinct) REQUIRE(report.oversubscribed);
+    if (distinct < cores.size()) REQUIRE(report.overlap);
+    // domain communicators used on some processes only must not make the check diverge
+    if (!ctx.domain_rank) REQUIRE(ctx.interdomain_comm != MPI_COMM_NULL);
+    report = ctx.check_binding(true);
+    REQUIRE(report.cpus == green::utils::get_affinity());
+    if (report.repinned && distinct >= size_t(ctx.node_size)) {
+      // after re-pinning core sets are disjoint
+      green::utils::binding_report again = ctx.check_binding();
+      REQUIRE(!again.overlap);
+    }
+    green::utils::thread_binding::get_instance().unbind(before);
+    REQUIRE(green::utils::get_affinity() == before);
+    REQUIRE(green::utils::thread_binding::get_instance().cpus().empty());
+  }
+
+  SECTION("Prefix sums") {
+    auto&  ctx   = green::utils::context;
+    size_t rank  = ctx.global_rank;
+    size_t size  = ctx.global_size;
+    size_t total = 0;
+    REQUIRE(green::utils::exscan(rank + 1, ctx.global, &total) == rank * (rank + 1) / 2);
+    REQUIRE(total == size * (size + 1) / 2);
+    REQUIRE(green::utils::scan(rank + 1, ctx.global) == (rank + 1) * (rank + 2) / 2);
+    std::vector<size_t> counts{1, rank, 2 * rank};
+    std::vector<size_t> totals;
+    std::vector<size_t> offsets = green::utils::exscan(counts, ctx.global, &totals);
+    REQUIRE(offsets == std::vector<size_t>{rank, rank * (rank - 1) / 2, rank * (rank - 1)});
+    REQUIRE(totals == std::vector<size_t>{size, size * (size - 1) / 2, size * (size - 1)});
+    // single node: node-major order coincides with global order
+    REQUIRE(green::utils::node_exscan(rank + 1, ctx, &total) == rank * (rank + 1) / 2);
+    REQUIRE(total == size * (size + 1) / 2);
+    REQUIRE(green::utils::node_exscan(counts, ctx, &totals) == offsets);
+    REQUIRE(totals == std::vector<size_t>{size, size * (size - 1) / 2, size * (size - 1)});
+  }
+
+  SECTION("Streaming reduction") {
+    int                 rank  = green::utils::context.global_rank;
+    int                 size  = green::utils::context.global_size;
+    size_t              total = 1000;
+    std::vector<double> result;
+    auto                consume = [&result](size_t offset, const double* data, size_t count) {
+      REQUIRE(offset == result.size());
+      result.insert(result.end(), data, data + count);
+    };
+    green::utils::stream_reducer<double> reducer(total, 64, MPI_COMM_WORLD, 0, consume, 2);
+    std::vector<double> block(10);
+    // every process contributes to a half of the array, blocks overlap between processes
+    for (size_t offset = rank % 2 ? 500 : 0; offset < (rank % 2 ? total : 500); offset += block.size()) {
+      std::iota(block.begin(), block.end(), double(offset));
+      reducer.push(offset, block.data(), block.size());
+      REQUIRE(reducer.buffered_chunks() <= 4);
+    }
+    REQUIRE_THROWS_AS(reducer.push(total - 5, block.data(), block.size()), green::utils::mpi_communication_error);
+    reducer.finalize();
+    REQUIRE(reducer.buffered_chunks() == 0);
+    if (!rank) {
+      REQUIRE(result.size() == total);
+      int  odd = size / 2;
+      bool ok  = true;
+      for (size_t i = 0; i < total; ++i) ok &= result[i] == double(i) * (i < 500 ? size - odd : odd);
+      REQUIRE(ok);
+    }
+  }
+
+  SECTION("Sample sort") {
+    struct record {
+      long   key;
+      double payload;
+    };
+    int                             rank = green::utils::context.global_rank;
+    std::mt19937                    gen(rank + 1);
+    std::uniform_int_distribution<> dist(0, 5000);
+    std::vector<record>             data(1000 + 100 * rank);
+    double                          checksum = 0;
+    for (auto& r : data) {
+      r.key     = dist(gen);
+      r.payload = r.key * 0.5;
+      checksum += r.payload;
+    }
+    size_t total = data.size();
+    auto   comp  = [](const record& a, const record& b) { return a.key < b.key; };
+    green::utils::sample_sort(data, MPI_COMM_WORLD, comp, 2);
+    REQUIRE(std::is_sorted(data.begin(), data.end(), comp));
+    REQUIRE(std::all_of(data.begin(), data.end(), [](const record& r) { return r.payload == r.key * 0.5; }));
+    auto   add_payload     = [](double s, const record& r) { return s + r.payload; };
+    double sorted_checksum = std::accumulate(data.begin(), data.end(), 0.0, add_payload);
+    size_t sorted_total    = data.size();
+    MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &sorted_total, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &checksum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &sorted_checksum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    REQUIRE(sorted_total == total);
+    REQUIRE(std::abs(sorted_checksum - checksum) < 1e-6);
+    // largest key of each process does not exceed smallest key of the next one
+    long              last = data.empty() ? -1 : data.back().key;
+    std::vector<long> lasts(green::utils::context.global_size);
+    MPI_Allgather(&last, 1, MPI_LONG, lasts.data(), 1, MPI_LONG, MPI_COMM_WORLD);
+    long previous = -1;
+    for (int p = 0; p < rank; ++p) previous = std::max(previous, lasts[p]);
+    if (!data.empty()) REQUIRE(previous <= data.front().key);
+  }
+
+  SECTION("Distributed write") {
+    green::utils::mpi_context ctx(MPI_COMM_WORLD);
+    // staging of four stripes forces several write rounds
+    ctx.workspace_size = 4096;
+    int                 rank  = ctx.global_rank;
+    int                 size  = ctx.global_size;
+    size_t              total = 1000 * size * (size + 1) / 2;
+    std::vector<double> local(1000 * (rank + 1));
+    std::iota(local.begin(), local.end(), 1000.0 * rank * (rank + 1) / 2);
+    green::utils::io_options opts;
+    opts.stripe_size = 1024;
+    green::utils::write_distributed("distributed_write_test.bin", local.data(), local.size(), ctx, opts);
+    if (!rank) {
+      std::ifstream             file("distributed_write_test.bin", std::ios::binary);
+      green::utils::file_header header;
+      file.read(reinterpret_cast<char*>(&header), sizeof(header));
+      REQUIRE(header.magic == green::utils::file_header::signature);
+      REQUIRE(header.element_size == sizeof(double));
+      REQUIRE(header.count == total);
+      REQUIRE(header.data_offset == 1024);
+      std::vector<double> data(total);
+      file.seekg(header.data_offset);
+      file.read(reinterpret_cast<char*>(data.data()), total * sizeof(double));
+      REQUIRE(size_t(file.gcount()) == total * sizeof(double));
+      std::vector<double> expected(total);
+      std::iota(expected.begin(), expected.end(), 0.0);
+      REQUIRE(data == expected);
+    }
+    green::utils::shared_object loaded(ref_array<double>{total});
+    green::utils::read_shared("distributed_write_test.bin", loaded);
+    std::vector<double> expected(total);
+    std::iota(expected.begin(), expected.end(), 0.0);
+    REQUIRE(std::equal(expected.begin(), expected.end(), loaded.object().data()));
+    green::utils::context.barrier().wait();
+    if (!green::utils::context.node_rank) std::fill(loaded.object().data(), loaded.object().data() + total, 0.0);
+    green::utils::context.barrier().wait();
+    green::utils::read_shared("distributed_write_test.bin", loaded, true);
+    REQUIRE(std::equal(expected.begin(), expected.end(), loaded.object().data()));
+    green::utils::shared_object wrong(ref_array<double>{total + 1});
+    REQUIRE_THROWS_AS(green::utils::read_shared("distributed_write_test.bin", wrong), green::utils::mpi_io_error);
+    REQUIRE_THROWS_AS(green::utils::read_shared("missing_file.bin", wrong), green::utils::mpi_io_error);
+    // only processes reading the second half run past the end of the file, all processes throw
+    REQUIRE_THROWS_AS(green::utils::read_shared("distributed_write_test.bin", 1024 + total * sizeof(double) / 2, loaded),
+                      green::utils::mpi_io_error);
+    REQUIRE_THROWS_AS(green::utils::write_distributed("missing_dir/distributed_write_test.bin", local.data(), local.size(), ctx, opts),
+                      green::utils::mpi_io_error);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!rank) std::remove("distributed_write_test.bin");
+  }
+
+  SECTION("Asynchronous checkpoint") {
+    auto&               ctx  = green::utils::context;
+    std::string         name = "checkpoint_test_" + std::to_string(ctx.global_rank) + ".bin";
+    std::vector<double> data(10000);
+    std::iota(data.begin(), data.end(), 0.0);
+    green::utils::timing statistic;
+    {
+      // budget smaller than two requests, second request waits for the first one
+      green::utils::async_checkpoint  writer(data.size() * sizeof(double) + 1);
+      green::utils::checkpoint_handle first  = writer.submit(name, data.data(), data.size());
+      green::utils::checkpoint_handle second = writer.submit(name, data.data(), data.size(), data.size() * sizeof(double));
+      REQUIRE(writer.staged_bytes() <= data.size() * sizeof(double));
+      std::fill(data.begin(), data.end(), -1.0);
+      second.wait();
+      REQUIRE(first.ready());
+      writer.report(statistic);
+      auto failed = writer.submit("missing_directory/checkpoint.bin", data.data(), 1);
+      REQUIRE_THROWS_AS(failed.wait(), green::utils::mpi_io_error);
+    }
+    REQUIRE(statistic.event("CHECKPOINT BACKGROUND WRITE").duration > 0);
+    std::ifstream       file(name, std::ios::binary);
+    std::vector<double> saved(2 * data.size());
+    file.read(reinterpret_cast<char*>(saved.data()), saved.size() * sizeof(double));
+    REQUIRE(size_t(file.gcount()) == saved.size() * sizeof(double));
+    bool                restored = true;
+    for (size_t i = 0; i < data.size(); ++i) restored &= saved[i] == i && saved[i + data.size()] == i;
+    REQUIRE(restored);
+    std::remove(name.c_str());
+
+    green::utils::shared_object shared(ref_array<double>{1001});
+    if (!ctx.node_rank) std::iota(shared.object().data(), shared.object().data() + shared.size(), 0.0);
+    ctx.barrier().wait();
+    std::string node_name = "checkpoint_node_" + std::to_string(ctx.internode_rank) + ".bin";
+    {
+      green::utils::async_checkpoint writer;
+      writer.submit(node_name, shared, ctx).wait();
+    }
+    ctx.barrier().wait();
+    std::ifstream       node_file(node_name, std::ios::binary);
+    std::vector<double> node_saved(shared.size());
+    node_file.read(reinterpret_cast<char*>(node_saved.data()), node_saved.size() * sizeof(double));
+    REQUIRE(std::equal(node_saved.begin(), node_saved.end(), shared.object().data()));
+    ctx.barrier().wait();
+    if (!ctx.node_rank) std::remove(node_name.c_str());
+  }
+
+  SECTION("Incremental checkpoint") {
+    auto&               ctx    = green::utils::context;
+    std::string         prefix = "incremental_test_" + std::to_string(ctx.global_rank);
+    std::vector<double> data(1000);
+    std::iota(data.begin(), data.end(), 0.0);
+    green::utils::incremental_checkpoint<double> checkpoint(prefix, data.size(), 64);
+    REQUIRE(checkpoint.save(data.data()) == checkpoint.nblocks());
+    REQUIRE(checkpoint.save(data.data()) == 0);
+    data[10]  = -1.0;
+    data[999] = -2.0;
+    REQUIRE(checkpoint.save(data.data()) == 2);
+    // explicitly marked block is stored even if its content did not change
+    checkpoint.mark_dirty(500, 1);
+    REQUIRE(checkpoint.save(data.data()) == 1);
+    std::vector<double> restored(data.size(), 0.0);
+    green::utils::incremental_checkpoint<double> reader(prefix, data.size(), 64);
+    reader.restore(restored.data());
+    REQUIRE(restored == data);
+    REQUIRE(reader.level() == 4);
+    reader.restore(restored.data(), 1);
+    REQUIRE(restored[10] == 10.0);
+    {
+      // manifest entry of the last level refers to a block out of range
+      std::fstream manifest(prefix + ".3.manifest", std::ios::binary | std::ios::in | std::ios::out);
+      uint64_t     block = checkpoint.nblocks();
+      manifest.seekp(sizeof(green::utils::incremental_checkpoint<double>::manifest_header));
+      manifest.write(reinterpret_cast<const char*>(&block), sizeof(block));
+    }
+    REQUIRE_THROWS_AS(reader.restore(restored.data()), green::utils::mpi_io_error);
+    {
+      // truncated manifest
+      std::string   name = prefix + ".2.manifest";
+      std::ifstream in(name, std::ios::binary);
+      std::string   content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      in.close();
+      std::ofstream(name, std::ios::binary).write(content.data(), content.size() - sizeof(uint64_t));
+    }
+    REQUIRE_THROWS_AS(reader.restore(restored.data(), 2), green::utils::mpi_io_error);
+    for (size_t l = 0; l < 4; ++l) {
+      std::remove((prefix + "." + std::to_string(l) + ".bin").c_str());
+      std::remove((prefix + "." + std::to_string(l) + ".manifest").c_str());
+    }
+    REQUIRE_THROWS_AS(reader.restore(restored.data()), green::utils::mpi_io_error);
+    // changes are not lost when a level cannot be written
+    std::string dir = "incremental_dir_" + std::to_string(ctx.global_rank);
+    std::filesystem::create_directory(dir);
+    green::utils::incremental_checkpoint<double> retry(dir + "/state", data.size(), 64);
+    REQUIRE(retry.save(data.data()) == retry.nblocks());
+    data[100] = -3.0;
+    std::filesystem::remove_all(dir);
+    REQUIRE_THROWS_AS(retry.save(data.data()), green::utils::mpi_io_error);
+    std::filesystem::create_directory(dir);
+    REQUIRE(retry.save(data.data()) == 1);
+    std::filesystem::remove_all(dir);
+
+    std::string                 node_prefix = "incremental_node_" + std::to_string(ctx.internode_rank);
+    green::utils::shared_object shared(ref_array<double>{1000});
+    if (!ctx.node_rank) std::iota(shared.object().data(), shared.object().data() + shared.size(), 0.0);
+    ctx.barrier().wait();
+    green::utils::incremental_checkpoint<double> node_checkpoint(node_prefix, shared.size(), 64);
+    size_t                                       stored = node_checkpoint.save(shared, ctx);
+    if (!ctx.node_rank) REQUIRE(stored == node_checkpoint.nblocks());
+    if (ctx.node_rank == ctx.node_size - 1) shared.object().data()[700] = -1.0;
+    ctx.barrier().wait();
+    stored = node_checkpoint.save(shared, ctx);
+    if (!ctx.node_rank) REQUIRE(stored == 1);
+    // every node writes its own files
+    if (!ctx.node_rank) REQUIRE(std::filesystem::exists(node_prefix + ".node" + std::to_string(ctx.internode_rank) + ".1.bin"));
+    std::vector<double> expected(shared.object().data(), shared.object().data() + shared.size());
+    ctx.barrier().wait();
+    if (!ctx.node_rank) std::fill(shared.object().data(), shared.object().data() + shared.size(), 0.0);
+    node_checkpoint.restore(shared, ctx);
+    REQUIRE(std::equal(expected.begin(), expected.end(), shared.object().data()));
+    REQUIRE(node_checkpoint.level() == 2);
+    // without hashes, blocks marked dirty by a process that does not check them are stored as well
+    std::string                                  marked_prefix = node_prefix + "_marked";
+    green::utils::incremental_checkpoint<double> marked(marked_prefix, shared.size(), 64, false);
+    marked.save(shared, ctx);
+    if (ctx.node_rank == ctx.node_size - 1) marked.mark_dirty(0, 1);
+    stored = marked.save(shared, ctx);
+    if (!ctx.node_rank) REQUIRE(stored == 1);
+    // failure of the node leader is reported on all node processes and the change is stored by the next save
+    std::string node_dir = "incremental_node_dir_" + std::to_string(ctx.internode_rank);
+    if (!ctx.node_rank) std::filesystem::create_directory(node_dir);
+    ctx.barrier().wait();
+    green::utils::incremental_checkpoint<double> node_retry(node_dir + "/state", shared.size(), 64);
+    node_retry.save(shared, ctx);
+    if (ctx.node_rank == ctx.node_size - 1) shared.object().data()[900] = -3.0;
+    if (!ctx.node_rank) std::filesystem::remove_all(node_dir);
+    ctx.barrier().wait();
+    REQUIRE_THROWS_AS(node_retry.save(shared, ctx), green::utils::mpi_io_error);
+    if (!ctx.node_rank) std::filesystem::create_directory(node_dir);
+    stored = node_retry.save(shared, ctx);
+    if (!ctx.node_rank) REQUIRE(stored == 1);
+    if (!ctx.node_rank) {
+      std::string node = ".node" + std::to_string(ctx.internode_rank);
+      for (size_t l = 0; l < 2; ++l) {
+        std::remove((marked_prefix + node + "." + std::to_string(l) + ".bin").c_str());
+        std::remove((marked_prefix + node + "." + std::to_string(l) + ".manifest").c_str());
+        std::remove((node_prefix + node + "." + std::to_string(l) + ".bin").c_str());
+        std::remove((node_prefix + node + "." + std::to_string(l) + ".manifest").c_str());
+      }
+      std::filesystem::remove_all(node_dir);
+    }
+  }
+
+  SECTION("Layout redistribution") {
+    int                               rank = green::utils::context.global_rank;
+    int                               size = green::utils::context.global_size;
+    size_t                            n    = 1001;
+    std::vector<int>                  owners(n);
+    for (size_t i = 0; i < n; ++i) owners[i] = (i * 7 / 3) % size;
+    std::vector<green::utils::layout> layouts{green::utils::layout::block(n, size), green::utils::layout::cyclic(n, size),
+                                              green::utils::layout::block_cyclic(n, size, 5),
+                                              green::utils::layout::custom(owners, size)};
+    bool                              ok = true;
+    for (auto& src : layouts) {
+      for (auto& dst : layouts) {
+        green::utils::redistribution plan(src, dst, MPI_COMM_WORLD);
+        std::vector<double>          in(src.local_size(rank));
+        std::vector<double>          out(dst.local_size(rank), -1.0);
+        src.for_each_local(rank, [&in](size_t i, size_t l) { in[l] = i; });
+        plan.execute(in.data(), out.data());
+        dst.for_each_local(rank, [&](size_t i, size_t l) { ok &= out[l] == i && dst.local_index(i) == l; });
+        // the same plan is reused for another element type
+        std::vector<long> in_long(in.begin(), in.end());
+        std::vector<long> out_long(out.size());
+        plan.execute(in_long.data(), out_long.data());
+        dst.for_each_local(rank, [&](size_t i, size_t l) { ok &= out_long[l] == long(i); });
+      }
+    }
+    REQUIRE(ok);
+
+    // redistribution within a small memory budget is done in several rounds
+    green::utils::mpi_context budget_ctx(MPI_COMM_WORLD);
+    budget_ctx.set_memory_budget(4096 * budget_ctx.node_size);
+    size_t node_size = budget_ctx.node_size;
+    REQUIRE(budget_ctx.workspace_bytes() == std::max<size_t>(2048 * node_size, 64 * node_size * node_size));
+    green::utils::redistribution plan(layouts[0], layouts[1], MPI_COMM_WORLD);
+    std::vector<double>          in(layouts[0].local_size(rank));
+    std::vector<double>          out(layouts[1].local_size(rank));
+    layouts[0].for_each_local(rank, [&in](size_t i, size_t l) { in[l] = i; });
+    plan.execute(in.data(), out.data(), budget_ctx);
+    layouts[1].for_each_local(rank, [&](size_t i, size_t l) { ok &= out[l] == i; });
+    REQUIRE(ok);
+    // allocated temporary buffers, rounded up to pool size classes, stay within the budget
+    size_t large = 100000;
+    budget_ctx.set_memory_budget(budget_ctx.workspace_bytes() + 20000 * node_size);
+    size_t                       budget = budget_ctx.temporary_budget();
+    green::utils::layout         large_src = green::utils::layout::block(large, size);
+    green::utils::layout         large_dst = green::utils::layout::cyclic(large, size);
+    green::utils::redistribution large_plan(large_src, large_dst, MPI_COMM_WORLD);
+    std::vector<double>          large_in(large_src.local_size(rank)), large_out(large_dst.local_size(rank));
+    large_src.for_each_local(rank, [&large_in](size_t i, size_t l) { large_in[l] = i; });
+    double& peak = green::utils::timing::get_instance().counter("memory budget peak temporary bytes");
+    peak         = 0;
+    double rounds_before = green::utils::timing::get_instance().counter("memory budget extra rounds");
+    large_plan.execute(large_in.data(), large_out.data(), budget_ctx);
+    large_dst.for_each_local(rank, [&](size_t i, size_t l) { ok &= large_out[l] == i; });
+    REQUIRE(ok);
+    if (size > 1) REQUIRE(green::utils::timing::get_instance().counter("memory budget extra rounds") > rounds_before);
+    REQUIRE(peak > 0);
+    REQUIRE(peak <= budget);
+    // budgets differ between processes, e.g. on nodes with different numbers of processes
+    size_t own_budget = rank ? 16384 * rank : std::numeric_limits<size_t>::max();
+    std::fill(large_out.begin(), large_out.end(), -1.0);
+    large_plan.execute(large_in.data(), large_out.data(), own_budget);
+    large_dst.for_each_local(rank, [&](size_t i, size_t l) { ok &= large_out[l] == i; });
+    REQUIRE(ok);
+    budget_ctx.workspace();
+    REQUIRE_NOTHROW(budget_ctx.set_memory_budget(budget_ctx.memory_budget()));
+    REQUIRE_THROWS_AS(budget_ctx.set_memory_budget(0), green::utils::mpi_shared_memory_error);
+
+    green::utils::redistribution identity(layouts[0], layouts[0], MPI_COMM_WORLD);
+    REQUIRE(identity.send_volume() == 0);
+    REQUIRE(identity.runs() == 1);
+    REQUIRE_THROWS_AS(green::utils::redistribution(layouts[0], green::utils::layout::block(n, size + 1), MPI_COMM_WORLD),
+                      green::utils::mpi_communicator_error);
+  }
+
+  SECTION("Distributed accumulate") {
+    auto&  ctx  = green::utils::context;
+    size_t n    = 1003;
+    // contributions of a rank: blocks of 7 ones at pseudo-random positions and single values
+    auto   each = [n](int rank, auto&& f) {
+      for (size_t k = 0; k < 100; ++k) f((rank * 37 + k * 13) % (n - 7), 7, 1.0);
+      for (size_t k = 0; k < 50; ++k) f((rank * 101 + k * 29) % n, 1, double(rank + 1));
+    };
+    std::vector<double> expected(n, 0.0);
+    for (int p = 0; p < ctx.global_size; ++p) {
+      each(p, [&expected](size_t index, size_t count, double value) {
+        for (size_t i = 0; i < count; ++i) expected[index + i] += value;
+      });
+    }
+    green::utils::distributed_array<double> array(n, ctx, 16, 8);
+    for (int round = 1; round <= 2; ++round) {
+      each(ctx.global_rank, [&array](size_t index, size_t count, double value) {
+        std::vector<double> block(count, value);
+        array.accumulate(block.data(), count, index);
+      });
+      array.flush();
+      bool ok = true;
+      for (size_t i = array.node_begin(); i < array.node_end(); ++i)
+        ok &= std::abs(array.node_data()[i - array.node_begin()] - round * expected[i]) < 1e-12;
+      REQUIRE(ok);
+      MPI_Barrier(MPI_COMM_WORLD);
+    }
+    REQUIRE(array.owner(0) == 0);
+    REQUIRE(array.owner(n - 1) == ctx.internode_size - 1);
+    array.zero();
+    REQUIRE(std::all_of(array.node_data(), array.node_data() + (array.node_end() - array.node_begin()),
+                        [](double x) { return x == 0.0; }));
+    REQUIRE_THROWS_AS(array.accumulate(1.0, n), green::utils::mpi_communication_error);
+  }
+
+  SECTION("Functor reductions") {
+    struct measurement {
+      double value;
+      double error;
+    };
+    auto   max_magnitude = [](double a, double b) { return std::abs(a) >= std::abs(b) ? a : b; };
+    auto   combine       = [](const measurement& a, const measurement& b) {
+      return measurement{a.value + b.value, std::sqrt(a.error * a.error + b.error * b.error)};
+    };
+    auto&  ctx  = green::utils::context;
+    int    rank = ctx.global_rank;
+    int    size = ctx.global_size;
+    double sign = (size - 1) % 2 ? -1.0 : 1.0;
+
+    std::vector<double> data(1000);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (rank % 2 ? -1.0 : 1.0) * (rank + 1) * (i + 1);
+    std::vector<double> result(data.size());
+    MPI_Allreduce(data.data(), result.data(), data.size(), MPI_DOUBLE, green::utils::functor_operation<double>(max_magnitude),
+                  MPI_COMM_WORLD);
+    bool ok = true;
+    for (size_t i = 0; i < result.size(); ++i) ok &= result[i] == sign * size * (i + 1);
+    REQUIRE(ok);
+
+    std::fill(result.begin(), result.end(), 0.0);
+    green::utils::hierarchical_allreduce(data.data(), result.data(), data.size(), ctx, max_magnitude);
+    for (size_t i = 0; i < result.size(); ++i) ok &= result[i] == sign * size * (i + 1);
+    REQUIRE(ok);
+
+    std::vector<measurement> m(10, measurement{double(rank), 1.0});
+    std::vector<measurement> total(m.size());
+    MPI_Allreduce(m.data(), total.data(), m.size(), green::utils::record_type<measurement>(),
+                  green::utils::functor_operation<measurement>(combine), MPI_COMM_WORLD);
+    REQUIRE(std::abs(total[9].value - size * (size - 1) / 2.0) < 1e-12);
+    REQUIRE(std::abs(total[9].error - std::sqrt(double(size))) < 1e-12);
+    green::utils::mpi_context local(MPI_COMM_WORLD);
+    local.workspace_size = 256;
+    green::utils::hierarchical_allreduce(m.data(), m.data(), m.size(), local, combine);
+    REQUIRE(std::abs(m[0].value - size * (size - 1) / 2.0) < 1e-12);
+    REQUIRE(std::abs(m[0].error - std::sqrt(double(size))) < 1e-12);
+    // state of a functor is taken from every call, not only from the first one
+    struct capped_max {
+      double cap;
+      double operator()(double a, double b) const { return std::min(std::max(a, b), cap); }
+    };
+    double value = rank + 1.0, capped;
+    MPI_Allreduce(&value, &capped, 1, MPI_DOUBLE, green::utils::functor_operation<double>(capped_max{0.5}), MPI_COMM_WORLD);
+    REQUIRE(capped == (size > 1 ? 0.5 : value));
+    MPI_Allreduce(&value, &capped, 1, MPI_DOUBLE, green::utils::functor_operation<double>(capped_max{1e10}), MPI_COMM_WORLD);
+    REQUIRE(capped == size);
+  }
+
+  SECTION("Logger") {
+    int                  rank = green::utils::context.global_rank;
+    int                  size = green::utils::context.global_size;
+    green::utils::logger log;
+    log.setup(MPI_COMM_WORLD);
+    REQUIRE(log.enabled(green::utils::log_level::info) == (rank == 0));
+    REQUIRE_FALSE(log.enabled(green::utils::log_level::debug));
+    log.set_ranks({});
+    log.set_nodes({green::utils::context.internode_rank});
+    REQUIRE(log.enabled(green::utils::log_level::info));
+    log.set_nodes({-1});
+    REQUIRE_FALSE(log.enabled(green::utils::log_level::error));
+    log.set_nodes({});
+    REQUIRE(green::utils::logger::rank_ranges({0, 1, 2, 3, 8, 10, 11}) == "0-3,8,10-11");
+
+    std::string prefix = "logger_test";
+    log.set_file(prefix);
+    log.set_aggregate(true);
+    log.info("same message");
+    log.info("message from ", rank % 2 ? "odd" : "even", " rank");
+    log.collect();
+    log.set_file("");
+    if (!rank) {
+      std::ifstream            in(prefix + ".0.log");
+      std::vector<std::string> lines;
+      for (std::string line; std::getline(in, line);) lines.push_back(line);
+      std::string all = size > 1 ? "0-" + std::to_string(size - 1) : "0";
+      REQUIRE(lines.size() == (size > 1 ? 3 : 2));
+      REQUIRE(lines[0] == "rank " + all + ": same message");
+      REQUIRE(lines[1].find("even rank") != std::string::npos);
+      std::remove((prefix + ".0.log").c_str());
+    }
+  }
+
+  SECTION("Watchdog") {
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_MULTIPLE) return;
+    int                  rank = green::utils::context.global_rank;
+    auto&                dog  = green::utils::watchdog::get_instance();
+    green::utils::timing statistic;
+    dog.start(MPI_COMM_WORLD, 0.2, statistic);
+    REQUIRE_THROWS_AS(dog.start(MPI_COMM_WORLD, 0.2, statistic), green::utils::mpi_communicator_error);
+    if (!rank) {
+      statistic.start("SLOW WORK");
+      std::this_thread::sleep_for(std::chrono::milliseconds(600));
+      statistic.end();
+    }
+    std::vector<double> data(4, rank);
+    green::utils::broadcast(data.data(), data.size(), MPI_COMM_WORLD, 0);
+    dog.stop();
+    REQUIRE_FALSE(dog.running());
+    std::string report = dog.last_report();
+    if (!rank) {
+      REQUIRE(report.find("event 'SLOW WORK' exceeded") != std::string::npos);
+    } else {
+      REQUIRE(report.find("collective 'broadcast' #") != std::string::npos);
+      REQUIRE(report.find("rank 0: has not entered collective") != std::string::npos);
+    }
+  }
+
   SECTION("AllReduce") {
     MPI_Comm            global        = green::utils::mpi_context::context.global;
     int                 global_size   = green::utils::mpi_context::context.global_size;
@@ -24,6 +24,8 @@
 #include <chrono>
 #include <thread>
 
+#include "green/utils/affinity.h"
+#include "green/utils/buffer_pool.h"
 #include "green/utils/timing.h"
 #include "green/utils/mpi_shared.h"
 
@@ -63,6 +65,15 @@ TEST_CASE("Timing") {
     REQUIRE_NOTHROW(statistic.print(MPI_COMM_WORLD));
   }
 
+  SECTION("Test Counters") {
+    green::utils::timing statistic;
+    statistic.counter("BYTES") += 10;
+    statistic.counter("BYTES") += 5;
+    REQUIRE(statistic.counter("BYTES") == 15);
+    REQUIRE_NOTHROW(statistic.print());
+    REQUIRE_NOTHROW(statistic.print(MPI_COMM_WORLD));
+  }
+
   SECTION("Test Nesting Events") {
     green::utils::timing statistic;
     double s = MPI_Wtime();
@@ -94,3 +105,58 @@ TEST_CASE("Timing") {
     statistic.end();
   }
 }
+
+TEST_CASE("Buffer pool") {
+  SECTION("Reuse") {
+    green::utils::buffer_pool pool(size_t(1) << 20, 256);
+    void*                     ptr = nullptr;
+    {
+      green::utils::pooled_buffer<double> buffer(1000, pool);
+      REQUIRE(buffer.size() == 1000);
+      REQUIRE(reinterpret_cast<uintptr_t>(buffer.data()) % 256 == 0);
+      ptr = buffer.data();
+    }
+    REQUIRE(pool.stats().cached == 8192);
+    green::utils::pooled_buffer<char> buffer(5000, pool);
+    REQUIRE(buffer.data() == ptr);
+    REQUIRE(pool.stats().hits == 1);
+    REQUIRE(pool.stats().misses == 1);
+    REQUIRE(pool.stats().in_use == 8192);
+    // failed allocation is not accounted
+    REQUIRE_THROWS_AS(green::utils::pooled_buffer<char>(size_t(1) << 60, pool), std::bad_alloc);
+    REQUIRE(pool.stats().in_use == 8192);
+    REQUIRE(pool.stats().peak == 8192);
+  }
+
+  SECTION("Bounded cache") {
+    green::utils::buffer_pool pool(size_t(1) << 14, 64, true);
+    {
+      green::utils::pooled_buffer<char> small(4096, pool);
+      green::utils::pooled_buffer<char> large(size_t(1) << 22, pool);
+      large[large.size() - 1] = 1;
+    }
+    REQUIRE(pool.stats().cached == 4096);
+    REQUIRE(pool.stats().peak == 4096 + (size_t(1) << 22));
+    pool.shrink();
+    REQUIRE(pool.stats().cached == 0);
+    green::utils::timing statistic;
+    pool.report(statistic);
+    REQUIRE(statistic.counter("buffer pool misses") == 2);
+  }
+}
+
+TEST_CASE("Thread binding") {
+  REQUIRE(green::utils::cpu_list({0, 1, 2, 3, 8, 10, 11}) == "0-3,8,10-11");
+  REQUIRE(green::utils::cpu_list({}).empty());
+  std::vector<int> cpus = green::utils::get_affinity();
+  REQUIRE(!cpus.empty());
+  REQUIRE(green::utils::set_affinity(cpus));
+  REQUIRE(!green::utils::set_affinity({}));
+  std::vector<int> helper;
+  std::thread      worker([&helper] {
+    green::utils::bound_thread binding;
+    helper = green::utils::get_affinity();
+  });
+  worker.join();
+  REQUIRE(helper == cpus);
+}